@@ -0,0 +1,462 @@
+/************************************************************************
+     File:        Bench.cpp
+
+     Comment:     water_bench - how long the frames of the TrainView take
+
+						Plays a camera path through the scene once for
+						every wave and quality setting, headless (see
+						EglContext.H), and writes the CPU time, the GPU
+						time of the frame and of every pass and draw in it
+						(TrainView::gpuProfiler), the draw calls and the
+						primitives of each frame as min / median / p95 /
+						p99 in JSON.
+
+						water_bench [--size 1280x720] [--frames 300]
+							[--warmup 30] [--path orbit|camera_path.txt]
+							[--waves sine,height] [--quality low,medium,high,screen]
+							[--scene points.txt] [--out results.json]
+							[--baseline results.json] [--check-allocs]
+						water_bench --compare base.json new.json
+
+						The path is the procedural orbit, or one recorded
+						with 'c' in the window (ArcBallCam::writePose).
+						--baseline compares the run with the results of an
+						earlier one (of another commit, say) when it is
+						done, --compare two result files.
+						--check-allocs counts the operator new calls the
+						draws of the measured frames make on this thread
+						and fails the run if there are any.
+
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "BenchResults.H"
+#include "EglContext.H"
+#include "TrainView.H"
+#include "Track.H"
+#include "RenderUtilities/DrawStats.h"
+#include "RenderUtilities/CpuProfiler.h"
+
+//************************************************************************
+//
+// * operator new counts while a draw of a measured frame is on this
+//   thread (--check-allocs). the driver threads are left out
+//========================================================================
+static thread_local bool countingAllocs = false;
+static thread_local size_t allocs = 0;
+
+void* operator new(size_t size)
+{
+	if (countingAllocs)
+		allocs++;
+	if (void* p = malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	free(p);
+}
+
+struct BenchOptions
+{
+	int width = 1280;
+	int height = 720;
+	int frames = 300;
+	int warmup = 30;
+	std::string path = "orbit";
+	std::vector<std::string> waves = { "sine", "height" };
+	std::vector<std::string> qualities = { "low", "medium", "high", "screen" };
+	std::string scene;
+	std::string out;		// empty = stdout
+	std::string baseline;
+	bool checkAllocs = false;
+};
+
+//************************************************************************
+//
+// * The quality settings the runs go through. medium is what the view
+//   starts with
+//========================================================================
+struct Quality
+{
+	const char* name;
+	int reflectionMode;
+	int reflectionInterval;
+	bool depthShading;
+	bool waterDepthPrepass;
+};
+
+static const Quality qualities[] = {
+	{ "low",	0, 4, false, false },
+	{ "medium", 0, 2, true,	true },
+	{ "high",	0, 1, true,	true },
+	{ "screen", 1, 2, true,	true },		// screen space reflection
+};
+
+//************************************************************************
+//
+// * Where the arcball is on every frame of a path
+//========================================================================
+struct Pose
+{
+	float eyeX, eyeY, eyeZ;
+	Quat rotation;
+};
+
+//========================================================================
+// A turn around the pool, bobbing up and down and in and out
+//========================================================================
+static std::vector<Pose>
+orbitPath(int frames)
+//========================================================================
+{
+	const float PI = 3.14159265f;
+	std::vector<Pose> path(frames);
+	for (int i = 0; i < frames; i++) {
+		float t = (float)i / frames;
+		float yaw = 2.0f * PI * t;
+		float pitch = 0.35f + 0.15f * sinf(4.0f * PI * t);
+		path[i].eyeX = 0.0f;
+		path[i].eyeY = 0.0f;
+		path[i].eyeZ = 250.0f + 50.0f * sinf(2.0f * PI * t);
+		path[i].rotation = Quat(sinf(pitch / 2), 0, 0, cosf(pitch / 2)) * Quat(0, sinf(yaw / 2), 0, cosf(yaw / 2));
+	}
+	return path;
+}
+
+//========================================================================
+// A path recorded with 'c'
+//========================================================================
+static bool
+readPath(const char* name, std::vector<Pose>& path)
+//========================================================================
+{
+	FILE* file = fopen(name, "r");
+	if (!file) {
+		fprintf(stderr, "water_bench: can't read %s\n", name);
+		return false;
+	}
+	ArcBallCam reader;
+	while (reader.readPose(file))
+		path.push_back({ reader.eyeX, reader.eyeY, reader.eyeZ, reader.start });
+	fclose(file);
+	if (path.empty())
+		fprintf(stderr, "water_bench: no poses in %s\n", name);
+	return !path.empty();
+}
+
+struct RunResult
+{
+	std::string wave;
+	std::string quality;
+	std::map<std::string, Summary> metrics;		// cpu_ms, gpu_ms, gpu_ms.<pass>/<scope>, ...
+	size_t allocs = 0;		// in the draws, with --check-allocs
+};
+
+//========================================================================
+// One wave and quality setting through the whole path. the runs share
+// the view, so its GL objects are made once and every run measures the
+// same driver state - it starts again from the same time and with no
+// reflection to reuse
+//========================================================================
+static RunResult
+runBench(const BenchOptions& options, const std::vector<Pose>& path, TrainView& view,
+	const std::string& wave, const Quality& quality)
+//========================================================================
+{
+	view.settings.wave = wave == "sine" ? 1 : (wave == "height" ? 2 : 0);
+	view.reflectionMode = quality.reflectionMode;
+	view.reflectionInterval = quality.reflectionInterval;
+	view.depthShading = quality.depthShading;
+	view.waterDepthPrepass = quality.waterDepthPrepass;
+	view.t_time = 0.0f;
+	view.reflectionValid = false;
+
+	auto pose = [&view, &path](int frame) {
+		const Pose& p = path[frame % path.size()];
+		view.arcball.eyeX = p.eyeX;
+		view.arcball.eyeY = p.eyeY;
+		view.arcball.eyeZ = p.eyeZ;
+		view.arcball.start = p.rotation;
+		view.arcball.now = Quat();
+	};
+
+	// the first draw of the first run loads glad and everything else -
+	// the counting entry points go in after it
+	for (int frame = 0; frame < options.warmup || frame == 0; frame++) {
+		pose(frame);
+		view.draw();
+	}
+	DrawStats::install();
+	// the profiler numbers the frames from 1, the earlier runs and the
+	// warm up ones included
+	const unsigned int warmedUp = view.gpuProfiler.getFrames();
+	unsigned int lastResult = 0;
+
+	DrawStats stats;
+	std::vector<double> cpu, drawCalls, primitives;
+	std::map<std::string, std::vector<double>> gpu;
+	allocs = 0;
+	for (int frame = 0; frame < options.frames; frame++) {
+		pose(frame);
+		auto start = std::chrono::steady_clock::now();
+		stats.begin();
+		countingAllocs = options.checkAllocs;
+		view.draw();
+		countingAllocs = false;
+		stats.end();
+		cpu.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		drawCalls.push_back(stats.getDrawCalls());
+		if (stats.poll())
+			primitives.push_back((double)stats.getPrimitives());
+
+		// the GPU times of a frame come back a few frames later (the last
+		// few of the run never do)
+		const GpuProfiler& profiler = view.gpuProfiler;
+		if (profiler.getResultFrame() != lastResult && profiler.getResultFrame() > warmedUp) {
+			lastResult = profiler.getResultFrame();
+			for (const GpuProfiler::Result& result : profiler.getResults())
+				gpu[result.depth ? "gpu_ms." + std::string(result.path + strlen("frame/")) : "gpu_ms"]
+					.push_back(result.milliseconds);
+		}
+	}
+	glFinish();
+	if (stats.poll())
+		primitives.push_back((double)stats.getPrimitives());
+
+	RunResult result;
+	result.wave = wave;
+	result.quality = quality.name;
+	result.allocs = allocs;
+	result.metrics["cpu_ms"] = summarize(cpu);
+	result.metrics["draw_calls"] = summarize(drawCalls);
+	result.metrics["primitives"] = summarize(primitives);
+	for (auto& scope : gpu)
+		result.metrics[scope.first] = summarize(scope.second);
+	return result;
+}
+
+//========================================================================
+static void
+writeResults(FILE* file, const BenchOptions& options, const std::vector<RunResult>& runs)
+//========================================================================
+{
+	fprintf(file, "{\n");
+	fprintf(file, "  \"renderer\": \"%s\",\n", (const char*)glGetString(GL_RENDERER));
+	fprintf(file, "  \"size\": [%d, %d],\n", options.width, options.height);
+	fprintf(file, "  \"frames\": %d,\n", options.frames);
+	fprintf(file, "  \"warmup\": %d,\n", options.warmup);
+	fprintf(file, "  \"path\": \"%s\",\n", options.path.c_str());
+	fprintf(file, "  \"runs\": [\n");
+	for (size_t r = 0; r < runs.size(); r++) {
+		const RunResult& run = runs[r];
+		fprintf(file, "    {\n");
+		fprintf(file, "      \"name\": \"%s/%s\",\n", run.wave.c_str(), run.quality.c_str());
+		fprintf(file, "      \"wave\": \"%s\",\n", run.wave.c_str());
+		fprintf(file, "      \"quality\": \"%s\",\n", run.quality.c_str());
+		size_t m = 0;
+		for (auto& metric : run.metrics)
+			writeMetric(file, metric.first, metric.second, ++m == run.metrics.size());
+		fprintf(file, "    }%s\n", r + 1 < runs.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+}
+
+//========================================================================
+static std::vector<std::string>
+splitList(const char* value)
+//========================================================================
+{
+	std::vector<std::string> list;
+	std::string item;
+	for (const char* c = value;; c++) {
+		if (*c == ',' || *c == '\0') {
+			if (!item.empty())
+				list.push_back(item);
+			item.clear();
+			if (*c == '\0')
+				return list;
+		}
+		else
+			item += *c;
+	}
+}
+
+//========================================================================
+static bool
+parseOptions(int argc, char** argv, BenchOptions& options)
+//========================================================================
+{
+	bool ok = true;
+	for (int i = 1; i < argc && ok; i++) {
+		const char* option = argv[i];
+		if (!strcmp(option, "--check-allocs")) {
+			options.checkAllocs = true;
+			continue;
+		}
+		const char* value = (i + 1 < argc) ? argv[++i] : NULL;
+		if (!value)
+			ok = false;
+		else if (!strcmp(option, "--size"))
+			ok = sscanf(value, "%dx%d", &options.width, &options.height) == 2 &&
+				options.width > 0 && options.height > 0;
+		else if (!strcmp(option, "--frames"))
+			ok = sscanf(value, "%d", &options.frames) == 1 && options.frames > 0;
+		else if (!strcmp(option, "--warmup"))
+			ok = sscanf(value, "%d", &options.warmup) == 1 && options.warmup >= 0;
+		else if (!strcmp(option, "--path"))
+			options.path = value;
+		else if (!strcmp(option, "--waves")) {
+			options.waves = splitList(value);
+			for (const std::string& wave : options.waves)
+				ok = ok && (wave == "sine" || wave == "height" || wave == "none");
+		}
+		else if (!strcmp(option, "--quality")) {
+			options.qualities = splitList(value);
+			for (const std::string& name : options.qualities) {
+				bool known = false;
+				for (const Quality& quality : qualities)
+					known = known || name == quality.name;
+				ok = ok && known;
+			}
+		}
+		else if (!strcmp(option, "--scene"))
+			options.scene = value;
+		else if (!strcmp(option, "--out"))
+			options.out = value;
+		else if (!strcmp(option, "--baseline"))
+			options.baseline = value;
+		else
+			ok = false;
+	}
+
+	if (!ok)
+		fprintf(stderr, "usage: %s [--size 1280x720] [--frames 300] [--warmup 30]\n"
+			"\t[--path orbit|camera_path.txt] [--waves sine,height,none]\n"
+			"\t[--quality low,medium,high,screen] [--scene points.txt]\n"
+			"\t[--out results.json] [--baseline results.json] [--check-allocs]\n"
+			"       %s --compare base.json new.json\n", argv[0], argv[0]);
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	PROFILE_THREAD("main");
+	if (argc == 4 && !strcmp(argv[1], "--compare"))
+		return compareResults(argv[2], argv[3]);
+
+	BenchOptions options;
+	if (!parseOptions(argc, argv, options))
+		return 1;
+
+	std::vector<Pose> path;
+	if (options.path == "orbit")
+		path = orbitPath(options.frames);
+	else if (!readPath(options.path.c_str(), path))
+		return 1;
+
+	EglContext context;
+	if (!context.create())
+		return 1;
+	if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+		fprintf(stderr, "water_bench: could not initialize GLAD\n");
+		return 1;
+	}
+	GpuMemory::install();
+	OutputFramebuffer output;
+	{
+		GpuMemory::Owner owner("output");
+		if (!output.create(options.width, options.height))
+			return 1;
+	}
+
+	CTrack track;
+	if (!options.scene.empty())
+		track.readPoints(options.scene.c_str());
+	TrainView view(0, 0, options.width, options.height);
+	view.m_pTrack = &track;
+	view.glLoader = (GLADloadproc)eglGetProcAddress;
+	view.outputFramebuffer = output.frameBuffer;
+	view.settings.worldCam = true;
+	view.settings.topCam = false;
+	// the same work on every run: no resolution changes on the way
+	view.deterministic = true;
+
+	std::vector<RunResult> runs;
+	try {
+		for (const std::string& wave : options.waves)
+			for (const std::string& name : options.qualities)
+				for (const Quality& quality : qualities)
+					if (name == quality.name) {
+						fprintf(stderr, "%s/%s\n", wave.c_str(), quality.name);
+						runs.push_back(runBench(options, path, view, wave, quality));
+					}
+	}
+	catch (const std::exception& e) {
+		fprintf(stderr, "water_bench: %s\n", e.what());
+		return 1;
+	}
+
+	FILE* file = options.out.empty() ? stdout : fopen(options.out.c_str(), "w");
+	if (!file) {
+		fprintf(stderr, "water_bench: can't write %s\n", options.out.c_str());
+		return 1;
+	}
+	writeResults(file, options, runs);
+	if (file != stdout)
+		fclose(file);
+	PROFILE_WRITE("water_bench_trace.json");
+	GpuMemory::report(stderr);
+
+	if (options.checkAllocs) {
+		bool allocated = false;
+		for (const RunResult& run : runs)
+			if (run.allocs) {
+				fprintf(stderr, "water_bench: %s/%s allocated %zu times in %d frames\n",
+					run.wave.c_str(), run.quality.c_str(), run.allocs, options.frames);
+				allocated = true;
+			}
+		if (allocated)
+			return 1;
+		fprintf(stderr, "water_bench: no allocations in the measured frames\n");
+	}
+
+	if (!options.baseline.empty() && !options.out.empty())
+		return compareResults(options.baseline.c_str(), options.out.c_str());
+	if (!options.baseline.empty())
+		fprintf(stderr, "water_bench: --baseline needs --out to compare with\n");
+	return 0;
+}
@@ -30,8 +30,8 @@
 #pragma warning(push)
 #pragma warning(disable:4312)
 #pragma warning(disable:4311)
-#include <Fl/Fl_File_Chooser.H>
-#include <Fl/math.h>
+#include <FL/Fl_File_Chooser.H>
+#include <FL/math.h>
 #pragma warning(pop)
 
 //***************************************************************************
@@ -134,6 +134,13 @@ static unsigned long lastRedraw = 0;
 void runButtonCB(TrainWindow* tw)
 //===========================================================================
 {
+	// a replay moves the train itself - draw when its next frame is due
+	InputReplay* replay = tw->trainView->inputReplay;
+	if (replay && !replay->finished()) {
+		if (replay->due())
+			tw->damageMe();
+		return;
+	}
 	if (tw->runButton->value()) {	// only advance time if appropriate
 		if (clock() - lastRedraw > CLOCKS_PER_SEC/30) {
 			lastRedraw = clock();
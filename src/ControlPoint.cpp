@@ -24,12 +24,14 @@
 
 *************************************************************************/
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <GL/gl.h>
 #include <math.h>
 
 #include "ControlPoint.H"
-#include "Utilities/3dUtils.h"
+#include "Utilities/3DUtils.h"
 
 //****************************************************************************
 //
@@ -0,0 +1,347 @@
+/************************************************************************
+     File:        Headless.cpp
+
+     Comment:     Running the renderer without a window (see Headless.H)
+
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "EglContext.H"
+#include "Headless.H"
+#include "InputRecording.H"
+#include "TrainView.H"
+#include "Track.H"
+#include "stb_image.h"
+
+//========================================================================
+bool
+isHeadless(int argc, char** argv)
+//========================================================================
+{
+	for (int i = 1; i < argc; i++)
+		if (!strcmp(argv[i], "--headless"))
+			return true;
+	return false;
+}
+
+//========================================================================
+bool
+parseHeadlessOptions(int argc, char** argv, HeadlessOptions& options)
+//========================================================================
+{
+	bool ok = true;
+	for (int i = 1; i < argc && ok; i++) {
+		const char* option = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (!strcmp(option, "--headless"))
+			continue;
+
+		// everything else takes a value
+		if (!value) {
+			ok = false;
+			break;
+		}
+		i++;
+		if (!strcmp(option, "--size"))
+			ok = sscanf(value, "%dx%d", &options.width, &options.height) == 2 &&
+				options.width > 0 && options.height > 0;
+		else if (!strcmp(option, "--frames"))
+			ok = sscanf(value, "%d", &options.frames) == 1 && options.frames > 0;
+		else if (!strcmp(option, "--scene"))
+			options.scene = value;
+		else if (!strcmp(option, "--camera")) {
+			options.camera = value;
+			ok = options.camera == "world" || options.camera == "top";
+		}
+		else if (!strcmp(option, "--capture")) {
+			options.capture = value;
+			FrameCapture::Format format;
+			ok = FrameCapture::formatOf(options.capture, format);
+		}
+		else if (!strcmp(option, "--golden") || !strcmp(option, "--update-golden")) {
+			options.golden = value;
+			options.updateGolden = !strcmp(option, "--update-golden");
+		}
+		else if (!strcmp(option, "--replay"))
+			options.replay = value;
+		else if (!strcmp(option, "--fps"))
+			ok = sscanf(value, "%d", &options.fps) == 1 && options.fps > 0;
+		else if (!strcmp(option, "--wave")) {
+			if (!strcmp(value, "sine"))
+				options.wave = 1;
+			else if (!strcmp(value, "height"))
+				options.wave = 2;
+			else if (!strcmp(value, "none"))
+				options.wave = 0;
+			else
+				ok = false;
+		}
+		else
+			ok = false;
+	}
+
+	if (!ok)
+		fprintf(stderr, "usage: %s --headless [--size 800x600] [--frames 100] [--scene points.txt]\n"
+			"\t[--camera world|top] [--wave sine|height|none]\n"
+			"\t[--capture frames/%%05d.png|frames/%%05d.rgba|out.y4m|-] [--fps 60]\n"
+			"\t[--golden DIR | --update-golden DIR] [--replay input.rec]\n", argv[0]);
+	return ok;
+}
+
+//************************************************************************
+//
+// * The golden image suite: snapshots of fixed cameras at fixed times,
+//   compared with stored references. Between them they cover both water
+//   shaders, the tiles and the sky, and both ways the reflection gets
+//   composed in
+//========================================================================
+struct GoldenSnapshot
+{
+	const char* name;
+	int wave;				// as in HeadlessOptions
+	const char* camera;
+	int reflectionMode;		// TrainView::reflectionMode
+	int frames;				// drawn before the snapshot - the time of it
+};
+
+static const GoldenSnapshot goldenSnapshots[] = {
+	{ "sine_world_planar",		1, "world", 0, 30 },
+	{ "sine_top_planar",		1, "top",	0, 30 },
+	{ "sine_world_screen",		1, "world", 1, 30 },
+	{ "height_world_planar",	2, "world", 0, 30 },
+	{ "height_top_screen",		2, "top",	1, 30 },
+	{ "tiles_world",			0, "world", 0, 1 },
+};
+
+// small, so the references stay small
+static const int GOLDEN_WIDTH = 320;
+static const int GOLDEN_HEIGHT = 240;
+
+// a pixel differs when its perceptual distance is over THRESHOLD (0 - 1),
+// a snapshot when over MAX_DIFFERENT of its pixels do - room for the odd
+// rounding of another driver, none for a real change
+static const float GOLDEN_THRESHOLD = 0.1f;
+static const float GOLDEN_MAX_DIFFERENT = 0.001f;
+
+//========================================================================
+// How far apart two colors look, 0 - 1: a weighted distance in YIQ, where
+// the brightness counts about twice as much as the hue (as in pixelmatch)
+//========================================================================
+static float
+colorDistance(const unsigned char* a, const unsigned char* b)
+//========================================================================
+{
+	float r = (float)a[0] - b[0];
+	float g = (float)a[1] - b[1];
+	float bl = (float)a[2] - b[2];
+	float y = r * 0.29889531f + g * 0.58662247f + bl * 0.11448223f;
+	float i = r * 0.59597799f - g * 0.27417610f - bl * 0.32180189f;
+	float q = r * 0.21147017f - g * 0.52261711f + bl * 0.31114694f;
+	// 35215 is black against white
+	return sqrtf((0.5053f * y * y + 0.299f * i * i + 0.1957f * q * q) / 35215.0f);
+}
+
+//========================================================================
+// Compare the frame (bottom row first) with the reference PNG. the diff
+// image gets the frame faded to grey, with the pixels that differ in red
+//========================================================================
+static bool
+compareGolden(const std::string& reference, const std::string& diff,
+	const std::vector<unsigned char>& frame, int width, int height)
+//========================================================================
+{
+	int referenceWidth, referenceHeight, components;
+	unsigned char* expected = stbi_load(reference.c_str(), &referenceWidth, &referenceHeight, &components, 4);
+	if (!expected) {
+		fprintf(stderr, "  no reference %s (--update-golden makes it)\n", reference.c_str());
+		return false;
+	}
+	if (referenceWidth != width || referenceHeight != height) {
+		fprintf(stderr, "  the reference is %dx%d, the snapshot %dx%d\n", referenceWidth, referenceHeight, width, height);
+		stbi_image_free(expected);
+		return false;
+	}
+
+	std::vector<unsigned char> image(frame.size());
+	int different = 0;
+	float worst = 0.0f;
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++) {
+			// the reference has the top row first
+			const unsigned char* want = &expected[((size_t)(height - 1 - y) * width + x) * 4];
+			const unsigned char* got = &frame[((size_t)y * width + x) * 4];
+			unsigned char* out = &image[((size_t)y * width + x) * 4];
+			float distance = colorDistance(want, got);
+			if (distance > worst)
+				worst = distance;
+			if (distance > GOLDEN_THRESHOLD) {
+				different++;
+				out[0] = 255;
+				out[1] = out[2] = 0;
+			}
+			else {
+				unsigned char grey = (unsigned char)(230 + 0.1f * (0.299f * got[0] + 0.587f * got[1] + 0.114f * got[2]));
+				out[0] = out[1] = out[2] = grey;
+			}
+			out[3] = 255;
+		}
+	stbi_image_free(expected);
+
+	bool same = different <= GOLDEN_MAX_DIFFERENT * width * height;
+	if (!same) {
+		fprintf(stderr, "  %d pixels differ (worst %.3f), see %s\n", different, worst, diff.c_str());
+		FrameCapture::writePNG(diff, width, height, image.data());
+	}
+	else if (different)
+		fprintf(stderr, "  %d pixels differ (worst %.3f), within the tolerance\n", different, worst);
+	return same;
+}
+
+//========================================================================
+// Draw every snapshot in a view of its own and compare it (or write it,
+// with updateGolden). returns the exit code
+//========================================================================
+static int
+runGoldenImages(const HeadlessOptions& options)
+//========================================================================
+{
+	OutputFramebuffer output;
+	if (!output.create(GOLDEN_WIDTH, GOLDEN_HEIGHT))
+		return 1;
+
+	int failed = 0;
+	int count = sizeof(goldenSnapshots) / sizeof(goldenSnapshots[0]);
+	for (int i = 0; i < count; i++) {
+		const GoldenSnapshot& snapshot = goldenSnapshots[i];
+		CTrack track;
+		if (!options.scene.empty())
+			track.readPoints(options.scene.c_str());
+
+		TrainView view(0, 0, GOLDEN_WIDTH, GOLDEN_HEIGHT);
+		view.m_pTrack = &track;
+		view.glLoader = (GLADloadproc)eglGetProcAddress;
+		view.settings.worldCam = !strcmp(snapshot.camera, "world");
+		view.settings.topCam = !strcmp(snapshot.camera, "top");
+		view.settings.wave = snapshot.wave;
+		view.reflectionMode = snapshot.reflectionMode;
+		view.deterministic = true;
+		view.outputFramebuffer = output.frameBuffer;
+
+		std::vector<unsigned char> frame((size_t)GOLDEN_WIDTH * GOLDEN_HEIGHT * 4);
+		try {
+			for (int f = 0; f < snapshot.frames; f++)
+				view.draw();
+		}
+		catch (const std::exception& e) {
+			fprintf(stderr, "Headless: %s\n", e.what());
+			return 1;
+		}
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, output.frameBuffer);
+		glReadPixels(0, 0, GOLDEN_WIDTH, GOLDEN_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, frame.data());
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+		std::string reference = options.golden + "/" + snapshot.name + ".png";
+		// the diff goes where the suite runs, not next to the references
+		std::string diff = std::string(snapshot.name) + ".diff.png";
+		if (options.updateGolden) {
+			bool written = FrameCapture::writePNG(reference, GOLDEN_WIDTH, GOLDEN_HEIGHT, frame.data());
+			fprintf(stderr, "%s %s\n", written ? "wrote" : "COULD NOT WRITE", reference.c_str());
+			failed += !written;
+			continue;
+		}
+		fprintf(stderr, "%s\n", snapshot.name);
+		bool same = compareGolden(reference, diff, frame, GOLDEN_WIDTH, GOLDEN_HEIGHT);
+		if (same)
+			remove(diff.c_str());
+		fprintf(stderr, "  %s\n", same ? "ok" : "FAILED");
+		failed += !same;
+	}
+
+	fprintf(stderr, "%d of %d golden images %s with %s\n", count - failed, count,
+		options.updateGolden ? "written" : "match", (const char*)glGetString(GL_RENDERER));
+	return failed ? 1 : 0;
+}
+
+//========================================================================
+int
+runHeadless(const HeadlessOptions& options)
+//========================================================================
+{
+	EglContext context;
+	if (!context.create())
+		return 1;
+	if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+		fprintf(stderr, "Headless: could not initialize GLAD\n");
+		return 1;
+	}
+	GpuMemory::install();
+	if (!options.golden.empty())
+		return runGoldenImages(options);
+
+	// the same view the window has, never shown. it loads glad through
+	// EGL again on its first draw
+	CTrack track;
+	if (!options.scene.empty())
+		track.readPoints(options.scene.c_str());
+
+	// a recording plays at the size it was made at, all of its frames
+	InputReplay replay;
+	int width = options.width, height = options.height, frames = options.frames;
+	if (!options.replay.empty()) {
+		if (!replay.open(options.replay.c_str()) || !replay.firstSize(width, height))
+			return 1;
+		frames = replay.frames();
+	}
+
+	TrainView view(0, 0, width, height);
+	view.m_pTrack = &track;
+	view.glLoader = (GLADloadproc)eglGetProcAddress;
+	view.settings.worldCam = options.camera == "world";
+	view.settings.topCam = options.camera == "top";
+	view.settings.wave = options.wave;
+	if (!options.replay.empty())
+		view.inputReplay = &replay;
+
+	OutputFramebuffer output;
+	{
+		GpuMemory::Owner owner("output");
+		if (!output.create(view.pixel_w(), view.pixel_h()))
+			return 1;
+	}
+	view.outputFramebuffer = output.frameBuffer;
+
+	// a capture is the same for every run of the same options
+	FrameCapture::Format format;
+	std::unique_ptr<FrameCapture> capture;
+	if (FrameCapture::formatOf(options.capture, format)) {
+		capture.reset(new FrameCapture(format, options.capture, options.fps));
+		view.capture = capture.get();
+		view.deterministic = true;
+	}
+
+	try {
+		for (int frame = 0; frame < frames; frame++)
+			view.draw();
+		if (capture)
+			capture->finish();
+		glFinish();
+	}
+	catch (const std::exception& e) {
+		fprintf(stderr, "Headless: %s\n", e.what());
+		return 1;
+	}
+
+	fprintf(stderr, "Drew %d frames at %dx%d with %s\n", frames, view.pixel_w(), view.pixel_h(),
+		(const char*)glGetString(GL_RENDERER));
+	GpuMemory::report(stderr);
+	if (capture && capture->failed())
+		return 1;
+	return 0;
+}
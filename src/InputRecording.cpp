@@ -0,0 +1,413 @@
+/************************************************************************
+     File:        InputRecording.cpp
+
+     Comment:     Recording what drives the TrainView and playing it back
+						(see InputRecording.H)
+
+*************************************************************************/
+
+#include <string.h>
+
+#include "InputRecording.H"
+#include "TrainView.H"
+#include "TrainWindow.H"
+
+#pragma warning(push)
+#pragma warning(disable:4312)
+#pragma warning(disable:4311)
+#include <FL/Fl.H>
+#pragma warning(pop)
+
+static const char MAGIC[4] = { 'W', 'R', 'E', 'C' };
+static const unsigned char VERSION = 1;
+
+enum RecordType { FRAME_RECORD = 1, EVENT_RECORD = 2, SETTINGS_RECORD = 3 };
+
+//************************************************************************
+//
+// * Little endian fields of a record
+//========================================================================
+static void
+put(std::vector<unsigned char>& record, unsigned int value, int bytes)
+//========================================================================
+{
+	for (int i = 0; i < bytes; i++)
+		record.push_back((unsigned char)(value >> (8 * i)));
+}
+
+static void
+putFloat(std::vector<unsigned char>& record, float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	put(record, bits, 4);
+}
+
+static unsigned int
+get(const unsigned char*& p, int bytes)
+{
+	unsigned int value = 0;
+	for (int i = 0; i < bytes; i++)
+		value |= (unsigned int)*p++ << (8 * i);
+	return value;
+}
+
+static int
+getSigned(const unsigned char*& p, int bytes)
+{
+	unsigned int value = get(p, bytes);
+	unsigned int sign = 1u << (8 * bytes - 1);
+	return bytes < 4 ? (int)(value ^ sign) - (int)sign : (int)value;
+}
+
+static float
+getFloat(const unsigned char*& p)
+{
+	unsigned int bits = get(p, 4);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+//************************************************************************
+//
+// * The widgets the view goes by, as they are now
+//========================================================================
+static RecordedSettings
+currentSettings(const TrainView& view)
+//========================================================================
+{
+	RecordedSettings settings;
+	settings.cameras = (view.settings.worldCam ? 1 : 0) | (view.settings.topCam ? 2 : 0) |
+		(view.settings.trainCam ? 4 : 0);
+	settings.wave = (unsigned char)view.settings.wave;
+	settings.amplitude = view.settings.amplitude;
+	settings.waveLength = view.settings.waveLength;
+	settings.speed = view.tw ? (float)view.tw->speed->value() : 0.0f;
+	settings.trainU = view.m_pTrack ? view.m_pTrack->trainU : 0.0f;
+	return settings;
+}
+
+//========================================================================
+InputRecorder::
+~InputRecorder()
+//========================================================================
+{
+	close();
+}
+
+//========================================================================
+bool InputRecorder::
+open(const char* path)
+//========================================================================
+{
+	close();
+	this->file = fopen(path, "wb");
+	if (!this->file) {
+		fprintf(stderr, "InputRecorder: can't write %s\n", path);
+		return false;
+	}
+	fwrite(MAGIC, 1, sizeof(MAGIC), this->file);
+	fwrite(&VERSION, 1, 1, this->file);
+	this->start = std::chrono::steady_clock::now();
+	this->written = false;
+	return true;
+}
+
+//========================================================================
+void InputRecorder::
+close()
+//========================================================================
+{
+	if (this->file)
+		fclose(this->file);
+	this->file = nullptr;
+}
+
+//========================================================================
+bool InputRecorder::
+isInput(int event)
+//========================================================================
+{
+	return event == FL_PUSH || event == FL_RELEASE || event == FL_DRAG ||
+		event == FL_MOUSEWHEEL || event == FL_KEYBOARD;
+}
+
+//========================================================================
+void InputRecorder::
+event(const TrainView& view, int event)
+//========================================================================
+{
+	if (!this->file || !isInput(event))
+		return;
+	// a widget changed since the last frame comes before the event, the
+	// view has already read it (TrainView::syncSettings)
+	settings(view);
+
+	std::vector<unsigned char> record;
+	record.push_back(EVENT_RECORD);
+	put(record, (unsigned int)event, 1);
+	put(record, (unsigned int)Fl::event_x(), 2);
+	put(record, (unsigned int)Fl::event_y(), 2);
+	put(record, (unsigned int)Fl::event_dy(), 1);
+	put(record, (unsigned int)Fl::event_clicks(), 1);
+	put(record, (unsigned int)Fl::event_state(), 4);
+	put(record, (unsigned int)Fl::event_key(), 4);
+	write(record);
+}
+
+//========================================================================
+void InputRecorder::
+frame(const TrainView& view)
+//========================================================================
+{
+	if (!this->file)
+		return;
+	settings(view);
+
+	unsigned int ms = (unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - this->start).count();
+	std::vector<unsigned char> record;
+	record.push_back(FRAME_RECORD);
+	put(record, ms, 4);
+	put(record, (unsigned int)view.w(), 2);
+	put(record, (unsigned int)view.h(), 2);
+	write(record);
+}
+
+//========================================================================
+// A settings record, if anything changed since the last one
+//========================================================================
+void InputRecorder::
+settings(const TrainView& view)
+//========================================================================
+{
+	RecordedSettings settings = currentSettings(view);
+	if (this->written && settings == this->last)
+		return;
+	this->last = settings;
+	this->written = true;
+
+	std::vector<unsigned char> record;
+	record.push_back(SETTINGS_RECORD);
+	put(record, settings.cameras, 1);
+	put(record, settings.wave, 1);
+	putFloat(record, settings.amplitude);
+	putFloat(record, settings.waveLength);
+	putFloat(record, settings.speed);
+	putFloat(record, settings.trainU);
+	write(record);
+}
+
+//========================================================================
+void InputRecorder::
+write(const std::vector<unsigned char>& record)
+//========================================================================
+{
+	if (fwrite(record.data(), 1, record.size(), this->file) != record.size()) {
+		fprintf(stderr, "InputRecorder: can't write the recording, it stops here\n");
+		close();
+	}
+}
+
+//************************************************************************
+//
+// * Read a recording. one cut short (the program died while recording)
+//   plays up to where it ends
+//========================================================================
+bool InputReplay::
+open(const char* path)
+//========================================================================
+{
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		fprintf(stderr, "InputReplay: can't read %s\n", path);
+		return false;
+	}
+	std::vector<unsigned char> data;
+	unsigned char buffer[4096];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		data.insert(data.end(), buffer, buffer + read);
+	fclose(file);
+
+	if (data.size() < sizeof(MAGIC) + 1 || memcmp(data.data(), MAGIC, sizeof(MAGIC)) ||
+		data[sizeof(MAGIC)] != VERSION) {
+		fprintf(stderr, "InputReplay: %s is not a recording of this version\n", path);
+		return false;
+	}
+
+	this->records.clear();
+	const unsigned char* p = data.data() + sizeof(MAGIC) + 1;
+	const unsigned char* end = data.data() + data.size();
+	while (p < end) {
+		Record record = {};
+		record.type = *p++;
+		size_t size = record.type == FRAME_RECORD ? 8 : (record.type == EVENT_RECORD ? 15 :
+			(record.type == SETTINGS_RECORD ? 18 : 0));
+		if (!size) {
+			fprintf(stderr, "InputReplay: %s is damaged, it plays up to there\n", path);
+			break;
+		}
+		if ((size_t)(end - p) < size)
+			break;
+		switch (record.type) {
+		case FRAME_RECORD:
+			record.ms = get(p, 4);
+			record.width = (int)get(p, 2);
+			record.height = (int)get(p, 2);
+			break;
+		case EVENT_RECORD:
+			record.event = (int)get(p, 1);
+			record.x = getSigned(p, 2);
+			record.y = getSigned(p, 2);
+			record.dy = getSigned(p, 1);
+			record.clicks = (int)get(p, 1);
+			record.state = (int)get(p, 4);
+			record.key = (int)get(p, 4);
+			break;
+		case SETTINGS_RECORD:
+			record.settings.cameras = (unsigned char)get(p, 1);
+			record.settings.wave = (unsigned char)get(p, 1);
+			record.settings.amplitude = getFloat(p);
+			record.settings.waveLength = getFloat(p);
+			record.settings.speed = getFloat(p);
+			record.settings.trainU = getFloat(p);
+			break;
+		}
+		this->records.push_back(record);
+	}
+
+	this->next = 0;
+	this->started = false;
+	if (!frames()) {
+		fprintf(stderr, "InputReplay: no frames in %s\n", path);
+		return false;
+	}
+	return true;
+}
+
+//========================================================================
+void InputReplay::
+frame(TrainView& view)
+//========================================================================
+{
+	if (!this->started) {
+		this->start = std::chrono::steady_clock::now();
+		this->started = true;
+	}
+	bool wasFinished = finished();
+	while (this->next < this->records.size()) {
+		const Record& record = this->records[this->next++];
+		if (record.type == FRAME_RECORD) {
+			this->width = record.width;
+			this->height = record.height;
+			break;
+		}
+		if (record.type == SETTINGS_RECORD)
+			apply(view, record.settings);
+		else
+			send(view, record);
+	}
+	if (!wasFinished && finished())
+		fprintf(stderr, "InputReplay: finished, %d frames\n", frames());
+}
+
+//========================================================================
+bool InputReplay::
+due() const
+//========================================================================
+{
+	if (!this->started)
+		return true;
+	size_t i = this->next;
+	while (i < this->records.size() && this->records[i].type != FRAME_RECORD)
+		i++;
+	if (i == this->records.size())
+		return true;
+	long long now = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - this->start).count();
+	return now >= (long long)this->records[i].ms;
+}
+
+//========================================================================
+int InputReplay::
+frames() const
+//========================================================================
+{
+	int frames = 0;
+	for (const Record& record : this->records)
+		frames += record.type == FRAME_RECORD;
+	return frames;
+}
+
+//========================================================================
+bool InputReplay::
+firstSize(int& width, int& height) const
+//========================================================================
+{
+	for (const Record& record : this->records)
+		if (record.type == FRAME_RECORD) {
+			width = record.width;
+			height = record.height;
+			return true;
+		}
+	return false;
+}
+
+//========================================================================
+// The widgets, and the settings the view reads from them - without a
+// window only the settings
+//========================================================================
+void InputReplay::
+apply(TrainView& view, const RecordedSettings& settings)
+//========================================================================
+{
+	view.settings.worldCam = (settings.cameras & 1) != 0;
+	view.settings.topCam = (settings.cameras & 2) != 0;
+	view.settings.trainCam = (settings.cameras & 4) != 0;
+	view.settings.wave = settings.wave;
+	view.settings.amplitude = settings.amplitude;
+	view.settings.waveLength = settings.waveLength;
+	if (view.m_pTrack)
+		view.m_pTrack->trainU = settings.trainU;
+
+	TrainWindow* tw = view.tw;
+	if (!tw)
+		return;
+	tw->worldCam->value(view.settings.worldCam);
+	tw->topCam->value(view.settings.topCam);
+	tw->trainCam->value(view.settings.trainCam);
+	if (settings.wave)
+		tw->waveBrowser->select(settings.wave);
+	else
+		tw->waveBrowser->deselect();
+	tw->amplitude->value(settings.amplitude);
+	tw->waveLength->value(settings.waveLength);
+	tw->speed->value(settings.speed);
+}
+
+//========================================================================
+// An event into TrainView::handle, with what Fl::event_x() and the rest
+// return while it is there
+//========================================================================
+void InputReplay::
+send(TrainView& view, const Record& record)
+//========================================================================
+{
+	int x = record.x, y = record.y;
+	if (this->width > 0 && this->height > 0 && (view.w() != this->width || view.h() != this->height)) {
+		x = x * view.w() / this->width;
+		y = y * view.h() / this->height;
+	}
+	Fl::e_x = x;
+	Fl::e_y = y;
+	Fl::e_dy = record.dy;
+	Fl::e_clicks = record.clicks;
+	Fl::e_state = record.state;
+	Fl::e_keysym = record.key;		// Fl::event_button() too
+
+	this->injecting = true;
+	view.handle(record.event);
+	this->injecting = false;
+}
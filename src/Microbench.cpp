@@ -0,0 +1,540 @@
+/************************************************************************
+     File:        Microbench.cpp
+
+     Comment:     water_microbench - how long the CPU side math and set
+						up code takes, one routine at a time
+
+						Every benchmark runs its loop in batches: the
+						batch grows until it takes --min-time, then runs
+						--repetitions more times, and the nanoseconds per
+						call of those batches go out as min / median / p95
+						/ p99 in the same JSON as water_bench
+						(BenchResults.H).
+
+						water_microbench [--filter matrix/] [--repetitions 10]
+							[--min-time 20] [--label abc123]
+							[--out results.json] [--baseline results.json]
+						water_microbench --list
+						water_microbench --compare base.json new.json
+
+						--filter runs the benchmarks with the text in
+						their name, --min-time is in milliseconds and
+						--label goes into the file as is (the commit, say:
+						--label `git rev-parse --short HEAD`). --baseline
+						compares the run with an earlier one when it is
+						done, --compare two result files.
+
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <glm/gtx/transform.hpp>
+
+#include "BenchResults.H"
+#include "TrainView.H"
+#include "Track.H"
+#include "Utilities/ArcBallCam.H"
+#include "Utilities/MatrixUtils.H"
+#include "Utilities/Pnt3f.H"
+
+// not in Track.H - Track.cpp only uses it for readPoints
+void breakString(char* str, std::vector<const char*>& words);
+
+//************************************************************************
+//
+// * What the loop of a benchmark runs on:
+//
+//		while (state.keepRunning())
+//			...
+//
+//   the clock runs from the first keepRunning to the last, so whatever
+//   comes before the loop is set up and not timed
+//========================================================================
+class BenchState
+{
+public:
+	explicit BenchState(long long iterations)
+		: iterations(iterations), left(iterations)
+	{
+	}
+
+	bool keepRunning()
+	{
+		if (left == iterations)
+			begin = std::chrono::steady_clock::now();
+		if (left-- > 0)
+			return true;
+		end = std::chrono::steady_clock::now();
+		return false;
+	}
+
+	double nanoseconds() const
+	{
+		return std::chrono::duration<double, std::nano>(end - begin).count();
+	}
+
+	const long long iterations;
+
+private:
+	long long left;
+	std::chrono::steady_clock::time_point begin, end;
+};
+
+//========================================================================
+// Makes the compiler believe value is read and written here, so the work
+// that goes into it isn't thrown away and the inputs aren't folded into
+// constants or hoisted out of the loop
+//========================================================================
+#if defined(__GNUC__)
+template <class T>
+inline void keep(T& value)
+{
+	asm volatile("" : "+m"(value) : : "memory");
+}
+#else
+// no inline assembly on x64: hand the address to a function the compiler
+// can't see through
+static void (*volatile escape)(void*) = [](void*) {};
+
+template <class T>
+inline void keep(T& value)
+{
+	escape((void*)&value);
+}
+#endif
+
+//************************************************************************
+//
+// * The inputs: a camera like the one the view draws with
+//========================================================================
+static void
+viewMatrix(float* m)
+//========================================================================
+{
+	ArcBallCam arcball;
+	arcball.eyeZ = 250.0f;
+	arcball.start = Quat(sinf(0.2f), 0, 0, cosf(0.2f)) * Quat(0, sinf(0.4f), 0, cosf(0.4f));
+	glm::mat4 view, projection;
+	arcball.getMatrices(16.0f / 9.0f, view, projection);
+	memcpy(m, &view[0][0], 16 * sizeof(float));
+}
+
+static void
+projectionMatrix(float* m)
+{
+	glm::mat4 projection = glm::perspective(glm::radians(40.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+	memcpy(m, &projection[0][0], 16 * sizeof(float));
+}
+
+//************************************************************************
+//
+// * MatrixUtils
+//========================================================================
+static void
+benchInvertMatrix(BenchState& state)
+//========================================================================
+{
+	float view[16], projection[16], m[16], out[16];
+	viewMatrix(view);
+	projectionMatrix(projection);
+	multMatrix(projection, view, m);
+	while (state.keepRunning()) {
+		keep(m);
+		invertMatrix(m, out);
+		keep(out);
+	}
+}
+
+static void
+benchInvertAffine(BenchState& state)
+{
+	float m[16], out[16];
+	viewMatrix(m);
+	while (state.keepRunning()) {
+		keep(m);
+		invertAffine(m, out);
+		keep(out);
+	}
+}
+
+static void
+benchMultMatrix(BenchState& state)
+{
+	float view[16], projection[16], out[16];
+	viewMatrix(view);
+	projectionMatrix(projection);
+	while (state.keepRunning()) {
+		keep(view);
+		keep(projection);
+		multMatrix(projection, view, out);
+		keep(out);
+	}
+}
+
+static void
+benchExtractCameraPos(BenchState& state)
+{
+	float view[16], pos[3];
+	viewMatrix(view);
+	while (state.keepRunning()) {
+		keep(view);
+		extractCameraPos(view, pos);
+		keep(pos);
+	}
+}
+
+//************************************************************************
+//
+// * The arcball
+//========================================================================
+static void
+benchQuatMultiply(BenchState& state)
+//========================================================================
+{
+	Quat a(sinf(0.2f), 0, 0, cosf(0.2f));
+	Quat b(0, sinf(0.4f), 0, cosf(0.4f));
+	while (state.keepRunning()) {
+		keep(a);
+		keep(b);
+		Quat c = a * b;
+		keep(c);
+	}
+}
+
+static void
+benchQuatToMatrix(BenchState& state)
+{
+	Quat q = Quat(sinf(0.2f), 0, 0, cosf(0.2f)) * Quat(0, sinf(0.4f), 0, cosf(0.4f));
+	HMatrix m;
+	while (state.keepRunning()) {
+		keep(q);
+		q.toMatrix(m);
+		keep(m);
+	}
+}
+
+// a drag across the window, one mouse position a call
+static void
+benchComputeNow(BenchState& state)
+{
+	ArcBallCam arcball;
+	arcball.mode = ArcBallCam::Rotate;
+	arcball.downX = -0.25f;
+	arcball.downY = 0.1f;
+	int i = 0;
+	while (state.keepRunning()) {
+		float t = (float)(i++ & 255) / 256.0f;
+		arcball.computeNow(t - 0.5f, 0.4f * t - 0.2f);
+		keep(arcball.now);
+	}
+}
+
+static void
+benchGetMatrices(BenchState& state)
+{
+	ArcBallCam arcball;
+	arcball.eyeZ = 250.0f;
+	arcball.start = Quat(sinf(0.2f), 0, 0, cosf(0.2f)) * Quat(0, sinf(0.4f), 0, cosf(0.4f));
+	glm::mat4 view, projection;
+	while (state.keepRunning()) {
+		keep(arcball);
+		arcball.getMatrices(16.0f / 9.0f, view, projection);
+		keep(view);
+		keep(projection);
+	}
+}
+
+//************************************************************************
+//
+// * Pnt3f
+//========================================================================
+static void
+benchPntCross(BenchState& state)
+//========================================================================
+{
+	Pnt3f a(1.0f, 2.0f, 3.0f), b(-0.5f, 0.25f, 4.0f);
+	while (state.keepRunning()) {
+		keep(a);
+		keep(b);
+		Pnt3f c = a * b;
+		keep(c);
+	}
+}
+
+static void
+benchPntScale(BenchState& state)
+{
+	Pnt3f a(1.0f, 2.0f, 3.0f);
+	float s = 0.75f;
+	while (state.keepRunning()) {
+		keep(a);
+		keep(s);
+		Pnt3f c = a * s;
+		keep(c);
+	}
+}
+
+static void
+benchPntAdd(BenchState& state)
+{
+	Pnt3f a(1.0f, 2.0f, 3.0f), b(-0.5f, 0.25f, 4.0f);
+	while (state.keepRunning()) {
+		keep(a);
+		keep(b);
+		Pnt3f c = a + b;
+		keep(c);
+	}
+}
+
+static void
+benchPntNormalize(BenchState& state)
+{
+	Pnt3f a(1.0f, 2.0f, 3.0f);
+	while (state.keepRunning()) {
+		Pnt3f c = a;
+		keep(c);
+		c.normalize();
+		keep(c);
+	}
+}
+
+//************************************************************************
+//
+// * Scene set up: the water grid (TrainView::initWaterGrid builds it with
+//   0.01 at WATER_HEIGHT) and the control point files
+//========================================================================
+static void
+benchBuildWaterGrid(BenchState& state)
+//========================================================================
+{
+	std::vector<GLfloat> vertices, texture_coordinate;
+	std::vector<GLuint> element;
+	while (state.keepRunning()) {
+		TrainView::buildWaterGrid(0.01f, 0.3f, vertices, texture_coordinate, element);
+		keep(vertices);
+	}
+}
+
+static const char* const POINTS_FILE = "water_microbench_points.txt";
+static const int POINTS = 1000;
+
+static void
+benchReadPoints(BenchState& state)
+{
+	FILE* file = fopen(POINTS_FILE, "w");
+	if (!file) {
+		fprintf(stderr, "water_microbench: can't write %s\n", POINTS_FILE);
+		exit(1);
+	}
+	fprintf(file, "%d\n", POINTS);
+	for (int i = 0; i < POINTS; i++)
+		fprintf(file, "%g %g %g %g %g %g\n", 50.0f * cosf(0.01f * i), 5.0f + 0.1f * (i % 20), 50.0f * sinf(0.01f * i),
+			0.1f * sinf(0.3f * i), 1.0f, 0.0f);
+	fclose(file);
+
+	CTrack track;
+	while (state.keepRunning()) {
+		track.readPoints(POINTS_FILE);
+		keep(track.points);
+	}
+	remove(POINTS_FILE);
+}
+
+// a line of a control point file - breakString writes into it, so every
+// call gets a fresh copy (the copy is timed too)
+static void
+benchBreakString(BenchState& state)
+{
+	const char line[] = "  -48.2735 5.3 12.9094 0.0247404 1 0 # control point\n";
+	char buffer[sizeof(line)];
+	std::vector<const char*> words;
+	while (state.keepRunning()) {
+		memcpy(buffer, line, sizeof(line));
+		keep(buffer);
+		breakString(buffer, words);
+		keep(words);
+	}
+}
+
+//************************************************************************
+//
+// * Everything there is to run, in order
+//========================================================================
+struct Microbench
+{
+	const char* name;
+	void (*run)(BenchState&);
+};
+
+static const Microbench benchmarks[] = {
+	{ "matrix/invertMatrix",		benchInvertMatrix },		// was TrainView::inverse
+	{ "matrix/invertAffine",		benchInvertAffine },
+	{ "matrix/multMatrix",			benchMultMatrix },
+	{ "matrix/extractCameraPos",	benchExtractCameraPos },	// was ExtractCameraPos
+	{ "arcball/quatMultiply",		benchQuatMultiply },
+	{ "arcball/quatToMatrix",		benchQuatToMatrix },
+	{ "arcball/computeNow",			benchComputeNow },
+	{ "arcball/getMatrices",		benchGetMatrices },
+	{ "pnt3f/cross",				benchPntCross },
+	{ "pnt3f/scale",				benchPntScale },
+	{ "pnt3f/add",					benchPntAdd },
+	{ "pnt3f/normalize",			benchPntNormalize },
+	{ "scene/buildWaterGrid",		benchBuildWaterGrid },
+	{ "scene/readPoints",			benchReadPoints },			// POINTS control points
+	{ "scene/breakString",			benchBreakString },
+};
+
+struct MicrobenchOptions
+{
+	std::string filter;
+	int repetitions = 10;
+	double minTime = 20;	// milliseconds a batch
+	std::string label;
+	std::string out;		// empty = stdout
+	std::string baseline;
+};
+
+struct MicrobenchResult
+{
+	const char* name;
+	long long iterations;
+	Summary nanoseconds;	// a call
+};
+
+//========================================================================
+// Time one benchmark: find how many calls fill minTime, then time that
+// many repetitions times
+//========================================================================
+static MicrobenchResult
+runMicrobench(const Microbench& bench, const MicrobenchOptions& options)
+//========================================================================
+{
+	const double minTime = options.minTime * 1.0e6;
+
+	long long iterations = 1;
+	for (;;) {
+		BenchState state(iterations);
+		bench.run(state);
+		double time = state.nanoseconds();
+		if (time >= minTime)
+			break;
+		// aim a bit over, but never grow more than 10 times at once - the
+		// first batches are too short to say much
+		long long next = time > 0 ? (long long)(iterations * 1.2 * minTime / time) : iterations * 10;
+		iterations = std::max(iterations + 1, std::min(next, iterations * 10));
+	}
+
+	std::vector<double> perCall;
+	for (int r = 0; r < options.repetitions; r++) {
+		BenchState state(iterations);
+		bench.run(state);
+		perCall.push_back(state.nanoseconds() / iterations);
+	}
+	return { bench.name, iterations, summarize(perCall) };
+}
+
+//========================================================================
+static void
+writeResults(FILE* file, const MicrobenchOptions& options, const std::vector<MicrobenchResult>& results)
+//========================================================================
+{
+	fprintf(file, "{\n");
+	fprintf(file, "  \"label\": \"%s\",\n", options.label.c_str());
+	fprintf(file, "  \"repetitions\": %d,\n", options.repetitions);
+	fprintf(file, "  \"min_time_ms\": %g,\n", options.minTime);
+	fprintf(file, "  \"runs\": [\n");
+	for (size_t r = 0; r < results.size(); r++) {
+		const MicrobenchResult& result = results[r];
+		fprintf(file, "    {\n");
+		fprintf(file, "      \"name\": \"%s\",\n", result.name);
+		fprintf(file, "      \"iterations\": %lld,\n", result.iterations);
+		writeMetric(file, "ns", result.nanoseconds, true);
+		fprintf(file, "    }%s\n", r + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+}
+
+//========================================================================
+static bool
+parseOptions(int argc, char** argv, MicrobenchOptions& options)
+//========================================================================
+{
+	bool ok = true;
+	for (int i = 1; i < argc && ok; i++) {
+		const char* option = argv[i];
+		const char* value = (i + 1 < argc) ? argv[++i] : NULL;
+		if (!value)
+			ok = false;
+		else if (!strcmp(option, "--filter"))
+			options.filter = value;
+		else if (!strcmp(option, "--repetitions"))
+			ok = sscanf(value, "%d", &options.repetitions) == 1 && options.repetitions > 0;
+		else if (!strcmp(option, "--min-time"))
+			ok = sscanf(value, "%lf", &options.minTime) == 1 && options.minTime > 0;
+		else if (!strcmp(option, "--label"))
+			options.label = value;
+		else if (!strcmp(option, "--out"))
+			options.out = value;
+		else if (!strcmp(option, "--baseline"))
+			options.baseline = value;
+		else
+			ok = false;
+	}
+
+	if (!ok)
+		fprintf(stderr, "usage: %s [--filter matrix/] [--repetitions 10] [--min-time 20]\n"
+			"\t[--label abc123] [--out results.json] [--baseline results.json]\n"
+			"       %s --list\n"
+			"       %s --compare base.json new.json\n", argv[0], argv[0], argv[0]);
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc == 2 && !strcmp(argv[1], "--list")) {
+		for (const Microbench& bench : benchmarks)
+			printf("%s\n", bench.name);
+		return 0;
+	}
+	if (argc == 4 && !strcmp(argv[1], "--compare"))
+		return compareResults(argv[2], argv[3]);
+
+	MicrobenchOptions options;
+	if (!parseOptions(argc, argv, options))
+		return 1;
+
+	std::vector<MicrobenchResult> results;
+	for (const Microbench& bench : benchmarks) {
+		if (!strstr(bench.name, options.filter.c_str()))
+			continue;
+		results.push_back(runMicrobench(bench, options));
+		fprintf(stderr, "%-28s %12.2f ns %12lld calls\n", bench.name, results.back().nanoseconds.median,
+			results.back().iterations);
+	}
+	if (results.empty()) {
+		fprintf(stderr, "water_microbench: nothing matches %s\n", options.filter.c_str());
+		return 1;
+	}
+
+	FILE* file = options.out.empty() ? stdout : fopen(options.out.c_str(), "w");
+	if (!file) {
+		fprintf(stderr, "water_microbench: can't write %s\n", options.out.c_str());
+		return 1;
+	}
+	writeResults(file, options, results);
+	if (file != stdout)
+		fclose(file);
+
+	if (!options.baseline.empty() && !options.out.empty())
+		return compareResults(options.baseline.c_str(), options.out.c_str());
+	if (!options.baseline.empty())
+		fprintf(stderr, "water_microbench: --baseline needs --out to compare with\n");
+	return 0;
+}
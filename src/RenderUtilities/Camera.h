@@ -0,0 +1,72 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include "../Utilities/MatrixUtils.H"
+
+// The matrices for the current frame, kept on the CPU.
+// Everything that used to read GL_MODELVIEW_MATRIX / GL_PROJECTION_MATRIX
+// back from the driver takes them from here instead.
+class Camera
+{
+public:
+	glm::mat4 view;
+	glm::mat4 projection;
+
+	// made from them once in set(), for whatever needs them in the frame
+	glm::mat4 viewProjection;
+	glm::mat4 inverseProjection;
+
+	// view mirrored about the water plane (for the reflection pass)
+	glm::mat4 reflectedView;
+
+	// eye position in world space
+	glm::vec3 position;
+
+	void set(const glm::mat4& view_matrix, const glm::mat4& projection_matrix)
+	{
+		this->view = view_matrix;
+		this->projection = projection_matrix;
+		extractCameraPos(&view_matrix[0][0], &this->position[0]);
+		multMatrix(&projection_matrix[0][0], &view_matrix[0][0], &this->viewProjection[0][0]);
+		if (!invertMatrix(&projection_matrix[0][0], &this->inverseProjection[0][0]))
+			this->inverseProjection = glm::mat4();
+	}
+
+	// mirror the view about the horizontal plane y = height (world space)
+	void setReflectionPlane(float height)
+	{
+		glm::mat4 mirror;
+		mirror[1][1] = -1.0f;
+		mirror[3][1] = 2.0f * height;
+		multMatrix(&this->view[0][0], &mirror[0][0], &this->reflectedView[0][0]);
+	}
+
+	// can any part of the world space box be inside the view frustum?
+	// conservative: only says no if all 8 corners are outside the same
+	// clip plane
+	bool isBoxVisible(const glm::vec3& box_min, const glm::vec3& box_max) const
+	{
+		const glm::mat4& view_projection = this->viewProjection;
+		int outside[6] = { 0, 0, 0, 0, 0, 0 };
+		for (int i = 0; i < 8; i++)
+		{
+			glm::vec4 corner(
+				(i & 1) ? box_max.x : box_min.x,
+				(i & 2) ? box_max.y : box_min.y,
+				(i & 4) ? box_max.z : box_min.z,
+				1.0f);
+			glm::vec4 clip = view_projection * corner;
+			outside[0] += clip.x < -clip.w;
+			outside[1] += clip.x > clip.w;
+			outside[2] += clip.y < -clip.w;
+			outside[3] += clip.y > clip.w;
+			outside[4] += clip.z < -clip.w;
+			outside[5] += clip.z > clip.w;
+		}
+		for (int i = 0; i < 6; i++)
+			if (outside[i] == 8)
+				return false;
+		return true;
+	}
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+// CPU profiling zones, written out as a Chrome trace (trace_event JSON -
+// it opens in Perfetto or chrome://tracing).
+//
+//	void TrainView::initHeightWater()
+//	{
+//		PROFILE_FUNCTION();
+//		...
+//		{
+//			PROFILE_ZONE("upload");
+//			...
+//		}
+//	}
+//	...
+//	PROFILE_WRITE("trace.json");		// once, at the end
+//
+// Without WATER_PROFILE the macros are nothing at all. With it a zone is
+// two clock reads and a store into a buffer of its own thread: no locks,
+// and no allocation but a new block every BLOCK_EVENTS zones. Only the
+// pointer of a name is kept, so names have to outlive the trace (string
+// literals, __FUNCTION__).
+
+#ifdef WATER_PROFILE
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+class CpuProfiler
+{
+public:
+	static const size_t BLOCK_EVENTS = 4096;
+
+	class Zone
+	{
+	public:
+		explicit Zone(const char* name)
+			: name(name), begin(now())
+		{
+		}
+
+		~Zone()
+		{
+			record(this->name, this->begin, now());
+		}
+
+	private:
+		const char* name;
+		long long begin;
+	};
+
+	// nanoseconds
+	static long long now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static void record(const char* name, long long begin, long long end)
+	{
+		Thread& thread = current();
+		Block* block = thread.last;
+		size_t count = block->count.load(std::memory_order_relaxed);
+		if (count == BLOCK_EVENTS) {
+			Block* next = new Block();
+			block->next.store(next, std::memory_order_release);
+			thread.last = block = next;
+			count = 0;
+		}
+		Event& event = block->events[count];
+		event.name = name;
+		event.begin = begin;
+		event.end = end;
+		// the writer only reads what count says is there
+		block->count.store(count + 1, std::memory_order_release);
+	}
+
+	// the name of the calling thread in the trace
+	static void setThreadName(const char* name)
+	{
+		current().name.store(name, std::memory_order_release);
+	}
+
+	// every zone recorded so far, of every thread. zones still being
+	// recorded by other threads just miss out
+	static bool write(const char* path)
+	{
+		FILE* file = fopen(path, "w");
+		if (!file) {
+			fprintf(stderr, "CpuProfiler: can't write %s\n", path);
+			return false;
+		}
+
+		Registry& registry = threads();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		const char* separator = "";
+		fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+		for (Thread* thread : registry.threads) {
+			const char* name = thread->name.load(std::memory_order_acquire);
+			if (name) {
+				fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+					separator, thread->id, name);
+				separator = ",";
+			}
+			for (Block* block = &thread->first; block; block = block->next.load(std::memory_order_acquire)) {
+				size_t count = block->count.load(std::memory_order_acquire);
+				for (size_t i = 0; i < count; i++) {
+					const Event& event = block->events[i];
+					// microseconds from the start
+					fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+						separator, event.name, thread->id, (event.begin - registry.start) / 1000.0,
+						(event.end - event.begin) / 1000.0);
+					separator = ",";
+				}
+			}
+		}
+		fprintf(file, "\n]}\n");
+		return fclose(file) == 0;
+	}
+
+private:
+	struct Event
+	{
+		const char* name;
+		long long begin;
+		long long end;
+	};
+
+	struct Block
+	{
+		Event events[BLOCK_EVENTS];
+		std::atomic<size_t> count{ 0 };
+		std::atomic<Block*> next{ nullptr };
+	};
+
+	// the zones of one thread. never freed - a thread that is gone still
+	// has its zones in the trace
+	struct Thread
+	{
+		Block first;
+		Block* last = &first;
+		std::atomic<const char*> name{ nullptr };
+		int id = 0;
+	};
+
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector<Thread*> threads;
+		long long start = now();
+	};
+
+	static Registry& threads()
+	{
+		static Registry registry;
+		return registry;
+	}
+
+	// the buffer of the calling thread, made on its first zone
+	static Thread& current()
+	{
+		static thread_local Thread* thread = nullptr;
+		if (!thread) {
+			thread = new Thread();
+			Registry& registry = threads();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			thread->id = (int)registry.threads.size() + 1;
+			registry.threads.push_back(thread);
+		}
+		return *thread;
+	}
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) CpuProfiler::Zone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__FUNCTION__)
+#define PROFILE_THREAD(name) CpuProfiler::setThreadName(name)
+#define PROFILE_WRITE(path) CpuProfiler::write(path)
+
+#else
+
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#define PROFILE_WRITE(path) ((void)0)
+
+#endif
@@ -0,0 +1,201 @@
+#pragma once
+#include <glad/glad.h>
+
+#include "Shader.h"
+
+// A min/max depth pyramid (hierarchical Z) for screen space depth queries.
+//
+// Level 0 is the depth buffer, every level after that keeps the nearest
+// (r) and farthest (g) depth of the texels under it. Odd sized levels fold
+// the left over row / column into their last texel, so a texel at any level
+// bounds everything it covers: a ray in front of its min is in front of the
+// whole area, a box behind its max is hidden by all of it.
+//
+// Building it is a compute pass (depthPyramidCS.glsl) that does up to five
+// levels per dispatch in shared memory. Use it as
+//
+//	pyramid.resize(w, h);
+//	pyramid.build(anyDepthTexture);		// or capture() + build()
+//	pyramid.bind(unit);					// texelFetch(sampler, texel, level).rg
+//
+// It can also keep a copy of the finished scene (capture), for effects that
+// need the color as well, like screen space reflection.
+class DepthPyramid
+{
+public:
+	static const int LEVELS_PER_DISPATCH = 5;
+
+	GLuint colorTexture = 0;
+	GLuint depthTexture = 0;
+	GLuint pyramidTexture = 0;
+
+	int width = 0;
+	int height = 0;
+	int levels = 0;
+
+	// takes the depthPyramidCS compute shader
+	DepthPyramid(Shader* shader)
+		: shader(shader)
+	{
+	}
+
+	~DepthPyramid()
+	{
+		cleanUp();
+		delete this->shader;
+	}
+
+	// the textures follow the window - only recreated when its size changes
+	void resize(int w, int h)
+	{
+		if (w == this->width && h == this->height && this->pyramidTexture)
+			return;
+		cleanUp();
+
+		this->width = w;
+		this->height = h;
+		this->levels = 1;
+		while ((w >> this->levels) > 0 || (h >> this->levels) > 0)
+			this->levels++;
+
+		this->colorTexture = createTexture(GL_RGBA8, 1);
+		this->depthTexture = createTexture(GL_DEPTH_COMPONENT32F, 1);
+		this->pyramidTexture = createTexture(GL_RG32F, this->levels);
+	}
+
+	// copy what is in the read framebuffer now (the finished scene)
+	void capture()
+	{
+		glBindTexture(GL_TEXTURE_2D, this->colorTexture);
+		glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, this->width, this->height);
+		glBindTexture(GL_TEXTURE_2D, this->depthTexture);
+		glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, this->width, this->height);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	// build from the captured depth
+	void build()
+	{
+		build(this->depthTexture);
+	}
+
+	// build from any depth texture the size of the pyramid
+	void build(GLuint depth)
+	{
+		this->shader->Use();
+		glUniform1i(glGetUniformLocation(this->shader->Program, "u_source"), 0);
+		glActiveTexture(GL_TEXTURE0);
+
+		int level = 0;
+		bool copy = true;
+		while (level < this->levels - 1)
+		{
+			int count = dispatchLevels(level);
+
+			glUniform1i(glGetUniformLocation(this->shader->Program, "u_copy"), copy);
+			glUniform2i(glGetUniformLocation(this->shader->Program, "u_sourceSize"),
+				levelSize(this->width, level), levelSize(this->height, level));
+			glUniform1i(glGetUniformLocation(this->shader->Program, "u_levels"), count);
+
+			if (copy) {
+				glBindTexture(GL_TEXTURE_2D, depth);
+				glBindImageTexture(0, this->pyramidTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+			}
+			else {
+				// the source level is the only one the sampler may see
+				glBindTexture(GL_TEXTURE_2D, this->pyramidTexture);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level);
+			}
+			for (int i = 0; i < count; i++)
+				glBindImageTexture(1 + i, this->pyramidTexture, level + 1 + i, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+
+			// one workgroup per 32x32 texels of the source level
+			glDispatchCompute(
+				(levelSize(this->width, level) + 31) / 32,
+				(levelSize(this->height, level) + 31) / 32, 1);
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+			level += count;
+			copy = false;
+		}
+
+		// a 1x1 screen has no levels to reduce, but level 0 still needs the copy
+		if (copy)
+			copyOnly(depth);
+
+		glBindTexture(GL_TEXTURE_2D, this->pyramidTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, this->levels - 1);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glUseProgram(0);
+	}
+
+	// the pyramid on a texture unit, for texelFetch
+	void bind(GLuint unit) const
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, this->pyramidTexture);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	void cleanUp()
+	{
+		if (!this->pyramidTexture)
+			return;
+		glDeleteTextures(1, &this->colorTexture);
+		glDeleteTextures(1, &this->depthTexture);
+		glDeleteTextures(1, &this->pyramidTexture);
+		this->pyramidTexture = 0;
+	}
+
+	static int levelSize(int size, int level)
+	{
+		int s = size >> level;
+		return s < 1 ? 1 : s;
+	}
+
+private:
+	// how many levels one dispatch can make from this one: the first
+	// always, every further one only while the level it comes from has
+	// even sizes (a workgroup's tile then never needs its neighbours)
+	int dispatchLevels(int source) const
+	{
+		int count = 1;
+		while (count < LEVELS_PER_DISPATCH && source + count < this->levels - 1) {
+			int w = levelSize(this->width, source + count);
+			int h = levelSize(this->height, source + count);
+			if ((w & 1) || (h & 1))
+				break;
+			count++;
+		}
+		return count;
+	}
+
+	void copyOnly(GLuint depth)
+	{
+		glUniform1i(glGetUniformLocation(this->shader->Program, "u_copy"), 1);
+		glUniform2i(glGetUniformLocation(this->shader->Program, "u_sourceSize"), this->width, this->height);
+		glUniform1i(glGetUniformLocation(this->shader->Program, "u_levels"), 0);
+		glBindTexture(GL_TEXTURE_2D, depth);
+		glBindImageTexture(0, this->pyramidTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+		glDispatchCompute(1, 1, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+
+	GLuint createTexture(GLenum format, int mipLevels)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexStorage2D(GL_TEXTURE_2D, mipLevels, format, this->width, this->height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipLevels > 1 ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mipLevels > 1 ? GL_NEAREST : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return texture;
+	}
+
+	Shader* shader;
+};
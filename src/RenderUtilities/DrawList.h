@@ -0,0 +1,109 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// The draws of one pass, put in the order that shades each pixel the
+// fewest times.
+//
+// Every draw goes in a bucket and the buckets are drawn in order:
+//	- BUCKET_OPAQUE: front to back, so the depth test throws away what is
+//	  hidden before it is shaded
+//	- BUCKET_SKY: after everything opaque, it only fills what is left (see
+//	  drawSkybox)
+//	- BUCKET_BLENDED: back to front, so each layer blends over what is
+//	  behind it (the sky included - anything drawn with alpha below 1
+//	  goes here). the names keep clear of OPAQUE, a macro of <wingdi.h>
+//
+// Draws are sorted by the distance from the eye to their bounding box (0
+// when the eye is inside it). A draw is a plain function with a pointer
+// and an int to go by - no std::function, whose captures may not fit its
+// small buffer - and the list keeps its storage between frames, so
+// filling it again doesn't allocate once it has grown.
+//
+//	list.begin(view_matrix);
+//	list.add(DrawList::BUCKET_OPAQUE, box_min, box_max,
+//		[](void* view, int mode) { ((TrainView*)view)->drawTiles(mode); }, this, mode);
+//	list.draw();
+class DrawList
+{
+public:
+	enum Bucket
+	{
+		BUCKET_OPAQUE,
+		BUCKET_SKY,
+		BUCKET_BLENDED
+	};
+
+	// a lambda without captures converts to it
+	typedef void (*DrawFunction)(void* context, int argument);
+
+	// start a new list, seen through this view
+	void begin(const glm::mat4& view_matrix)
+	{
+		this->items.clear();
+		// the eye is where the view's translation came from
+		glm::mat3 rotation(view_matrix);
+		this->eye = -(glm::transpose(rotation) * glm::vec3(view_matrix[3]));
+	}
+
+	// a draw with a world space bounding box
+	void add(Bucket bucket, const glm::vec3& box_min, const glm::vec3& box_max,
+		DrawFunction draw, void* context, int argument = 0)
+	{
+		glm::vec3 closest = glm::clamp(this->eye, box_min, box_max);
+		Item item = { bucket, glm::distance(this->eye, closest), draw, context, argument };
+		this->items.push_back(item);
+	}
+
+	// a draw that covers everything (the sky)
+	void add(Bucket bucket, DrawFunction draw, void* context, int argument = 0)
+	{
+		Item item = { bucket, 0.0f, draw, context, argument };
+		this->items.push_back(item);
+	}
+
+	void draw()
+	{
+		// insertion sort: a pass has a handful of draws, and unlike
+		// std::stable_sort it needs no buffer. stable, so draws at the
+		// same distance keep the order they were added in
+		for (size_t i = 1; i < this->items.size(); i++) {
+			Item item = this->items[i];
+			size_t j = i;
+			for (; j > 0 && before(item, this->items[j - 1]); j--)
+				this->items[j] = this->items[j - 1];
+			this->items[j] = item;
+		}
+
+		for (size_t i = 0; i < this->items.size(); i++)
+			this->items[i].draw(this->items[i].context, this->items[i].argument);
+	}
+
+	size_t size() const
+	{
+		return this->items.size();
+	}
+
+private:
+	struct Item
+	{
+		Bucket bucket;
+		float distance;
+		DrawFunction draw;
+		void* context;
+		int argument;
+	};
+
+	static bool before(const Item& a, const Item& b)
+	{
+		if (a.bucket != b.bucket)
+			return a.bucket < b.bucket;
+		if (a.bucket == BUCKET_BLENDED)
+			return a.distance > b.distance;
+		return a.distance < b.distance;
+	}
+
+	std::vector<Item> items;
+	glm::vec3 eye;
+};
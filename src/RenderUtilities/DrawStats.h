@@ -0,0 +1,198 @@
+#pragma once
+#include <glad/glad.h>
+
+// Counts what a frame sends to the GPU: its draw calls, and the primitives
+// they make (a GL_PRIMITIVES_GENERATED query around the frame).
+//
+// The draw calls are counted by swapping glad's draw entry points for ones
+// that count and call through, so no call site has to know. install() has
+// to run after glad is loaded - loading it again puts the real ones back.
+//
+// Like GpuTimer, the query results are picked up a few frames later, when
+// they are (almost always) there already, instead of waiting for them.
+//
+//	DrawStats::install();
+//	...every frame:
+//	stats.begin();
+//	...draw...
+//	stats.end();
+//	if (stats.poll()) ...stats.getPrimitives()...
+class DrawStats
+{
+public:
+	static const int LATENCY = 4;
+
+	~DrawStats()
+	{
+		if (this->created)
+			glDeleteQueries(LATENCY, this->queries);
+	}
+
+	static void install()
+	{
+		Entries& real = entries();
+		if (glad_glDrawArrays == countDrawArrays)
+			return;
+		real.drawArrays = glad_glDrawArrays;
+		real.drawElements = glad_glDrawElements;
+		real.drawArraysInstanced = glad_glDrawArraysInstanced;
+		real.drawElementsInstanced = glad_glDrawElementsInstanced;
+		real.drawElementsBaseVertex = glad_glDrawElementsBaseVertex;
+		real.drawElementsInstancedBaseVertex = glad_glDrawElementsInstancedBaseVertex;
+		real.drawRangeElements = glad_glDrawRangeElements;
+		glad_glDrawArrays = countDrawArrays;
+		glad_glDrawElements = countDrawElements;
+		glad_glDrawArraysInstanced = countDrawArraysInstanced;
+		glad_glDrawElementsInstanced = countDrawElementsInstanced;
+		glad_glDrawElementsBaseVertex = countDrawElementsBaseVertex;
+		glad_glDrawElementsInstancedBaseVertex = countDrawElementsInstancedBaseVertex;
+		glad_glDrawRangeElements = countDrawRangeElements;
+	}
+
+	// draw calls since the start, from every context and every DrawStats
+	static unsigned long long totalDrawCalls()
+	{
+		return entries().calls;
+	}
+
+	void begin()
+	{
+		if (!this->created)
+		{
+			glGenQueries(LATENCY, this->queries);
+			this->created = true;
+		}
+
+		int index = this->frame % LATENCY;
+		this->active = !this->pending[index] || collect(index);
+		if (this->active)
+			glBeginQuery(GL_PRIMITIVES_GENERATED, this->queries[index]);
+		this->firstCall = totalDrawCalls();
+	}
+
+	void end()
+	{
+		this->drawCalls = (unsigned int)(totalDrawCalls() - this->firstCall);
+		if (this->active)
+		{
+			glEndQuery(GL_PRIMITIVES_GENERATED);
+			this->pending[this->frame % LATENCY] = true;
+		}
+		this->active = false;
+		this->frame++;
+	}
+
+	// pick up every finished query without waiting. returns true if a new
+	// primitive count arrived since the last call
+	bool poll()
+	{
+		bool updated = false;
+		for (int i = 1; i <= LATENCY; i++)
+		{
+			// oldest first
+			int index = (this->frame + i) % LATENCY;
+			if (this->pending[index] && collect(index))
+				updated = true;
+		}
+		return updated;
+	}
+
+	// draw calls between the last begin and end
+	unsigned int getDrawCalls() const
+	{
+		return this->drawCalls;
+	}
+
+	// the latest primitive count
+	GLuint64 getPrimitives() const
+	{
+		return this->primitives;
+	}
+
+private:
+	struct Entries
+	{
+		PFNGLDRAWARRAYSPROC drawArrays;
+		PFNGLDRAWELEMENTSPROC drawElements;
+		PFNGLDRAWARRAYSINSTANCEDPROC drawArraysInstanced;
+		PFNGLDRAWELEMENTSINSTANCEDPROC drawElementsInstanced;
+		PFNGLDRAWELEMENTSBASEVERTEXPROC drawElementsBaseVertex;
+		PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXPROC drawElementsInstancedBaseVertex;
+		PFNGLDRAWRANGEELEMENTSPROC drawRangeElements;
+		unsigned long long calls;
+	};
+
+	// the real entry points, and the count
+	static Entries& entries()
+	{
+		static Entries real = {};
+		return real;
+	}
+
+	static void APIENTRY countDrawArrays(GLenum mode, GLint first, GLsizei count)
+	{
+		entries().calls++;
+		entries().drawArrays(mode, first, count);
+	}
+
+	static void APIENTRY countDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+	{
+		entries().calls++;
+		entries().drawElements(mode, count, type, indices);
+	}
+
+	static void APIENTRY countDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances)
+	{
+		entries().calls++;
+		entries().drawArraysInstanced(mode, first, count, instances);
+	}
+
+	static void APIENTRY countDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices,
+		GLsizei instances)
+	{
+		entries().calls++;
+		entries().drawElementsInstanced(mode, count, type, indices, instances);
+	}
+
+	static void APIENTRY countDrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices,
+		GLint baseVertex)
+	{
+		entries().calls++;
+		entries().drawElementsBaseVertex(mode, count, type, indices, baseVertex);
+	}
+
+	static void APIENTRY countDrawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type,
+		const void* indices, GLsizei instances, GLint baseVertex)
+	{
+		entries().calls++;
+		entries().drawElementsInstancedBaseVertex(mode, count, type, indices, instances, baseVertex);
+	}
+
+	static void APIENTRY countDrawRangeElements(GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type,
+		const void* indices)
+	{
+		entries().calls++;
+		entries().drawRangeElements(mode, start, end, count, type, indices);
+	}
+
+	bool collect(int index)
+	{
+		GLint available = 0;
+		glGetQueryObjectiv(this->queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return false;
+		glGetQueryObjectui64v(this->queries[index], GL_QUERY_RESULT, &this->primitives);
+		this->pending[index] = false;
+		return true;
+	}
+
+	GLuint queries[LATENCY];
+	bool pending[LATENCY] = {};
+	bool created = false;
+	bool active = false;
+	unsigned int frame = 0;
+
+	unsigned long long firstCall = 0;
+	unsigned int drawCalls = 0;
+	GLuint64 primitives = 0;
+};
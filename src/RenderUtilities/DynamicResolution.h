@@ -0,0 +1,55 @@
+#pragma once
+
+// Picks the resolution scale of a render target so the pass drawing into it
+// stays within a time budget.
+//
+// Feed it the GPU time of the pass (see GpuTimer) whenever a measurement
+// arrives. Above the budget the scale steps down, well below it the scale
+// steps back up. The scale moves in fixed steps and waits a few samples
+// after every change, so the target isn't recreated every frame and the
+// delayed timings of the old size don't cause a second step.
+class DynamicResolution
+{
+public:
+	float scale;
+	float minScale;
+	float maxScale;
+	float step = 0.125f;
+
+	// milliseconds the pass may take
+	double budget;
+
+	DynamicResolution(float scale, float minScale, float maxScale, double budget)
+		: scale(scale), minScale(minScale), maxScale(maxScale), budget(budget)
+	{
+	}
+
+	// returns true if the scale changed
+	bool update(double milliseconds)
+	{
+		// smooth out single slow frames
+		this->average = this->samples ? this->average * 0.75 + milliseconds * 0.25 : milliseconds;
+		this->samples++;
+		if (this->samples < SETTLE_SAMPLES)
+			return false;
+
+		float old_scale = this->scale;
+		if (this->average > this->budget && this->scale > this->minScale)
+			this->scale = this->scale - this->step < this->minScale ? this->minScale : this->scale - this->step;
+		// only grow with some headroom, or it would bounce between two sizes
+		else if (this->average < this->budget * 0.6 && this->scale < this->maxScale)
+			this->scale = this->scale + this->step > this->maxScale ? this->maxScale : this->scale + this->step;
+
+		if (this->scale == old_scale)
+			return false;
+
+		this->samples = 0;
+		return true;
+	}
+
+private:
+	static const int SETTLE_SAMPLES = 8;
+
+	double average = 0.0;
+	int samples = 0;
+};
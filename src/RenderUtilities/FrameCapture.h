@@ -0,0 +1,492 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "CpuProfiler.h"
+#include "GpuMemory.h"
+
+// Writes every frame to disk, as raw RGBA, PNG files or one Y4M stream.
+//
+// capture() only starts the read back: glReadPixels goes into one of a
+// ring of RING pixel pack buffers behind a fence, and the buffer is mapped
+// frames later when the fence has (almost always) passed - the frame that
+// issued the read never waits for it. The pixels are then handed to worker
+// threads that flip, encode and write them. They encode in parallel but
+// write strictly in frame order (a Y4M stream has to be in order), and at
+// most MAX_QUEUED frames wait for them before capture() blocks, so a slow
+// disk slows the capture down instead of filling the memory.
+//
+//	FrameCapture capture(FrameCapture::PNG, "frames/%05d.png");
+//	...every frame, after drawing: capture.capture(framebuffer, w, h);
+//	capture.finish();		// with the context still current
+//
+// PNGs are written uncompressed (stored deflate blocks) - cheap to make,
+// big on disk. Raw frames are the RGBA bytes, top row first. Y4M is 4:2:0
+// with full range BT.601 colors ("C420jpeg"), its path "-" is stdout.
+class FrameCapture
+{
+public:
+	enum Format
+	{
+		RAW,
+		PNG,
+		Y4M
+	};
+
+	static const int RING = 3;
+	static const int MAX_QUEUED = 8;
+
+	// path: a printf pattern for the frame number for RAW and PNG
+	// ("frames/%05d.png"), the one file for Y4M
+	FrameCapture(Format format, const std::string& path, int fps = 60)
+		: format(format), path(path), fps(fps)
+	{
+	}
+
+	~FrameCapture()
+	{
+		finish();
+	}
+
+	// the format that goes with the extension of path (.rgba, .png or
+	// .y4m, "-" is Y4M on stdout). false if there is none
+	static bool formatOf(const std::string& path, Format& format)
+	{
+		if (path == "-" || endsWith(path, ".y4m"))
+			format = Y4M;
+		else if (endsWith(path, ".png"))
+			format = PNG;
+		else if (endsWith(path, ".rgba"))
+			format = RAW;
+		else
+			return false;
+		return true;
+	}
+
+	// start reading back the width x height pixels of the framebuffer
+	void capture(GLuint framebuffer, int width, int height)
+	{
+		if (this->finished)
+			return;
+		if (!this->started)
+			start();
+
+		// the slot is free once the frame RING back is collected
+		if (this->submitted - this->collected == RING)
+			collect(true);
+
+		Slot& slot = this->slots[this->submitted % RING];
+		size_t size = (size_t)width * height * 4;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		if (slot.capacity < size) {
+			glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+			slot.capacity = size;
+		}
+
+		GLint readFramebuffer;
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot.width = width;
+		slot.height = height;
+		this->submitted++;
+
+		// hand over whatever has arrived by now, oldest first
+		while (this->collected < this->submitted && collect(false))
+			;
+	}
+
+	// wait for every frame to be read back and written. needs the context
+	void finish()
+	{
+		if (!this->started || this->finished)
+			return;
+		while (this->collected < this->submitted)
+			collect(true);
+		glDeleteBuffers(RING, this->buffers);
+
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->stopping = true;
+		}
+		this->queued.notify_all();
+		for (size_t i = 0; i < this->workers.size(); i++)
+			this->workers[i].join();
+		this->workers.clear();
+
+		if (this->stream && this->stream != stdout)
+			fclose(this->stream);
+		else if (this->stream)
+			fflush(this->stream);
+		this->stream = NULL;
+		this->finished = true;
+	}
+
+	// one PNG on the spot, from RGBA pixels with the bottom row first (as
+	// glReadPixels has them)
+	static bool writePNG(const std::string& name, int width, int height, const unsigned char* pixels)
+	{
+		std::vector<unsigned char> encoded;
+		encodePNG(width, height, pixels, encoded);
+		FILE* file = fopen(name.c_str(), "wb");
+		if (!file)
+			return false;
+		bool written = fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+		return fclose(file) == 0 && written;
+	}
+
+	// frames read back so far
+	size_t frames() const
+	{
+		return this->collected;
+	}
+
+	bool failed() const
+	{
+		return this->error;
+	}
+
+private:
+	struct Slot
+	{
+		GLsync fence = 0;
+		GLuint buffer = 0;
+		size_t capacity = 0;
+		int width = 0;
+		int height = 0;
+	};
+
+	struct Job
+	{
+		size_t frame;
+		int width;
+		int height;
+		std::vector<unsigned char> pixels;	// bottom row first, as read
+	};
+
+	static bool endsWith(const std::string& s, const char* end)
+	{
+		size_t n = strlen(end);
+		return s.size() >= n && s.compare(s.size() - n, n, end) == 0;
+	}
+
+	void start()
+	{
+		GpuMemory::Owner owner("frame capture");
+		glGenBuffers(RING, this->buffers);
+		for (int i = 0; i < RING; i++)
+			this->slots[i].buffer = this->buffers[i];
+
+		// leave a core for drawing
+		unsigned int count = std::thread::hardware_concurrency();
+		count = count > 2 ? count - 1 : 1;
+		for (unsigned int i = 0; i < count; i++)
+			this->workers.push_back(std::thread(&FrameCapture::work, this));
+		this->started = true;
+	}
+
+	// map the oldest slot and queue its pixels. false if it hasn't arrived
+	// and wait is off
+	bool collect(bool wait)
+	{
+		Slot& slot = this->slots[this->collected % RING];
+		GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+			return false;
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+
+		Job job;
+		job.frame = this->collected;
+		job.width = slot.width;
+		job.height = slot.height;
+		job.pixels.resize((size_t)slot.width * slot.height * 4);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, job.pixels.size(), GL_MAP_READ_BIT);
+		if (pixels) {
+			memcpy(job.pixels.data(), pixels, job.pixels.size());
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		this->collected++;
+
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->space.wait(lock, [this]() { return this->jobs.size() < MAX_QUEUED; });
+		this->jobs.push_back(std::move(job));
+		lock.unlock();
+		this->queued.notify_one();
+		return true;
+	}
+
+	void work()
+	{
+		PROFILE_THREAD("frame capture");
+		for (;;)
+		{
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(this->mutex);
+				this->queued.wait(lock, [this]() { return this->stopping || !this->jobs.empty(); });
+				if (this->jobs.empty())
+					return;
+				job = std::move(this->jobs.front());
+				this->jobs.pop_front();
+			}
+			this->space.notify_one();
+
+			std::vector<unsigned char> encoded;
+			{
+				PROFILE_ZONE("FrameCapture::encode");
+				encode(job, encoded);
+			}
+
+			// the earlier frames first
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->turn.wait(lock, [this, &job]() { return this->nextWrite == job.frame; });
+			lock.unlock();
+			{
+				PROFILE_ZONE("FrameCapture::write");
+				write(job, encoded);
+			}
+			lock.lock();
+			this->nextWrite++;
+			lock.unlock();
+			this->turn.notify_all();
+		}
+	}
+
+	void encode(const Job& job, std::vector<unsigned char>& out) const
+	{
+		if (this->format == Y4M)
+			encodeY4M(job, out);
+		else if (this->format == PNG)
+			encodePNG(job.width, job.height, job.pixels.data(), out);
+		else {
+			// flipped, the top row first
+			size_t row = (size_t)job.width * 4;
+			out.resize(row * job.height);
+			for (int y = 0; y < job.height; y++)
+				memcpy(&out[y * row], &job.pixels[(job.height - 1 - y) * row], row);
+		}
+	}
+
+	// runs on one worker at a time, in frame order
+	void write(const Job& job, const std::vector<unsigned char>& encoded)
+	{
+		if (this->error)
+			return;
+
+		if (this->format == Y4M) {
+			if (!this->stream) {
+				if (this->path == "-") {
+#ifdef _WIN32
+					_setmode(_fileno(stdout), _O_BINARY);
+#endif
+					this->stream = stdout;
+				}
+				else
+					this->stream = fopen(this->path.c_str(), "wb");
+				if (!this->stream) {
+					fail("can't open " + this->path);
+					return;
+				}
+				this->width = job.width;
+				this->height = job.height;
+				fprintf(this->stream, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", job.width, job.height, this->fps);
+			}
+			// a stream can't change size
+			if (job.width != this->width || job.height != this->height) {
+				fail("the frame size changed, the Y4M stream stops here");
+				return;
+			}
+			fputs("FRAME\n", this->stream);
+			if (fwrite(encoded.data(), 1, encoded.size(), this->stream) != encoded.size())
+				fail("can't write " + this->path);
+			return;
+		}
+
+		char name[1024];
+		snprintf(name, sizeof(name), this->path.c_str(), (int)job.frame);
+		FILE* file = fopen(name, "wb");
+		if (!file) {
+			fail(std::string("can't open ") + name);
+			return;
+		}
+		if (fwrite(encoded.data(), 1, encoded.size(), file) != encoded.size())
+			fail(std::string("can't write ") + name);
+		fclose(file);
+	}
+
+	void fail(const std::string& message)
+	{
+		fprintf(stderr, "FrameCapture: %s\n", message.c_str());
+		this->error = true;
+	}
+
+	// planes Y, Cb, Cr - chroma from the average of 2x2 pixels
+	static void encodeY4M(const Job& job, std::vector<unsigned char>& out)
+	{
+		int w = job.width, h = job.height;
+		int cw = (w + 1) / 2, ch = (h + 1) / 2;
+		out.resize((size_t)w * h + 2 * (size_t)cw * ch);
+		unsigned char* yPlane = &out[0];
+		unsigned char* cbPlane = yPlane + (size_t)w * h;
+		unsigned char* crPlane = cbPlane + (size_t)cw * ch;
+
+		// the top row is the last one read
+		auto pixel = [&job, w, h](int x, int y) { return &job.pixels[(((size_t)(h - 1 - y)) * w + x) * 4]; };
+		for (int y = 0; y < h; y++)
+			for (int x = 0; x < w; x++) {
+				const unsigned char* p = pixel(x, y);
+				yPlane[(size_t)y * w + x] = clamp(0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2]);
+			}
+		for (int y = 0; y < ch; y++)
+			for (int x = 0; x < cw; x++) {
+				float r = 0, g = 0, b = 0;
+				int n = 0;
+				for (int dy = 0; dy < 2 && 2 * y + dy < h; dy++)
+					for (int dx = 0; dx < 2 && 2 * x + dx < w; dx++, n++) {
+						const unsigned char* p = pixel(2 * x + dx, 2 * y + dy);
+						r += p[0];
+						g += p[1];
+						b += p[2];
+					}
+				r /= n;
+				g /= n;
+				b /= n;
+				cbPlane[(size_t)y * cw + x] = clamp(128.0f - 0.168736f * r - 0.331264f * g + 0.5f * b);
+				crPlane[(size_t)y * cw + x] = clamp(128.0f + 0.5f * r - 0.418688f * g - 0.081312f * b);
+			}
+	}
+
+	static unsigned char clamp(float v)
+	{
+		return (unsigned char)(v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v + 0.5f));
+	}
+
+	// RGBA, 8 bits, no filter, stored (uncompressed) deflate blocks
+	static void encodePNG(int width, int height, const unsigned char* pixels, std::vector<unsigned char>& out)
+	{
+		size_t row = (size_t)width * 4;
+		std::vector<unsigned char> raw;
+		raw.reserve((row + 1) * height);
+		for (int y = 0; y < height; y++) {
+			raw.push_back(0);	// filter: none
+			const unsigned char* p = &pixels[(height - 1 - y) * row];
+			raw.insert(raw.end(), p, p + row);
+		}
+
+		std::vector<unsigned char> zlib;
+		zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+		zlib.push_back(0x78);
+		zlib.push_back(0x01);
+		size_t at = 0;
+		do {
+			size_t n = raw.size() - at < 65535 ? raw.size() - at : 65535;
+			zlib.push_back(at + n == raw.size() ? 1 : 0);	// last block?
+			zlib.push_back(n & 0xff);
+			zlib.push_back((n >> 8) & 0xff);
+			zlib.push_back(~n & 0xff);
+			zlib.push_back((~n >> 8) & 0xff);
+			zlib.insert(zlib.end(), raw.begin() + at, raw.begin() + at + n);
+			at += n;
+		} while (at < raw.size());
+		unsigned int a = 1, b = 0;
+		for (size_t i = 0; i < raw.size(); i++) {
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		putBigEndian(zlib, (b << 16) | a);
+
+		static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		out.assign(signature, signature + 8);
+		std::vector<unsigned char> header;
+		putBigEndian(header, width);
+		putBigEndian(header, height);
+		const unsigned char format[5] = { 8, 6, 0, 0, 0 };	// 8 bits, RGBA
+		header.insert(header.end(), format, format + 5);
+		putChunk(out, "IHDR", header);
+		putChunk(out, "IDAT", zlib);
+		putChunk(out, "IEND", std::vector<unsigned char>());
+	}
+
+	static void putBigEndian(std::vector<unsigned char>& out, unsigned int v)
+	{
+		out.push_back((v >> 24) & 0xff);
+		out.push_back((v >> 16) & 0xff);
+		out.push_back((v >> 8) & 0xff);
+		out.push_back(v & 0xff);
+	}
+
+	static void putChunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data)
+	{
+		putBigEndian(out, (unsigned int)data.size());
+		size_t start = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data.begin(), data.end());
+		putBigEndian(out, crc(&out[start], out.size() - start));
+	}
+
+	static unsigned int crc(const unsigned char* data, size_t size)
+	{
+		static unsigned int table[256];
+		static std::once_flag once;
+		std::call_once(once, []() {
+			for (unsigned int n = 0; n < 256; n++) {
+				unsigned int c = n;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				table[n] = c;
+			}
+		});
+		unsigned int c = 0xffffffffu;
+		for (size_t i = 0; i < size; i++)
+			c = table[(c ^ data[i]) & 0xff] ^ (c >> 8);
+		return c ^ 0xffffffffu;
+	}
+
+	Format format;
+	std::string path;
+	int fps;
+
+	// GL side, only touched by the thread with the context
+	Slot slots[RING];
+	GLuint buffers[RING];
+	size_t submitted = 0;
+	size_t collected = 0;
+	bool started = false;
+	bool finished = false;
+
+	// worker side
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable queued;		// a job, or stopping
+	std::condition_variable space;		// room in jobs
+	std::condition_variable turn;		// nextWrite moved on
+	std::deque<Job> jobs;
+	size_t nextWrite = 0;
+	bool stopping = false;
+	FILE* stream = NULL;
+	int width = 0;
+	int height = 0;
+	std::atomic<bool> error{ false };
+};
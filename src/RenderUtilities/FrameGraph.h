@@ -0,0 +1,613 @@
+#pragma once
+#include <glad/glad.h>
+
+#include "CpuProfiler.h"
+#include "GpuMemory.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <iostream>
+
+// A small frame graph for the passes of one frame.
+//
+// Passes say which resources they read and write, the graph works out the
+// order, drops passes whose results nobody uses and hands out the transient
+// render targets from a pool (targets whose lifetimes don't overlap share
+// one texture).
+//
+// Resources are either
+//	- transient textures (createTexture): owned by the graph, only valid
+//	  inside the frame
+//	- imported targets (importTarget): a framebuffer somebody else owns,
+//	  like the default framebuffer or the water FBOs. an imported target
+//	  marked as output is what keeps the passes writing it alive
+//
+// The graph is built once. What compile() works out is kept for every set
+// of enabled passes it has seen (up to 64 passes), so turning a pass on and
+// off again - the amortised reflection does that every few frames - finds
+// its order and textures instead of compiling again. Only changing the
+// graph or the size of a transient texture throws that away. A frame that
+// hits a set it has seen doesn't allocate.
+class FrameGraph
+{
+public:
+	typedef int Resource;
+	typedef int Pass;
+
+	struct TextureDesc
+	{
+		int width;
+		int height;
+		GLenum internalFormat;
+
+		bool operator==(const TextureDesc& o) const
+		{
+			return width == o.width && height == o.height && internalFormat == o.internalFormat;
+		}
+	};
+
+	Resource createTexture(const char* name, const TextureDesc& desc)
+	{
+		ResourceNode node;
+		node.name = name;
+		node.desc = desc;
+		resources.push_back(node);
+		dirty = true;
+		return (Resource)resources.size() - 1;
+	}
+
+	Resource importTarget(const char* name, GLuint framebuffer, GLuint texture, int width, int height, bool output = false)
+	{
+		ResourceNode node;
+		node.name = name;
+		node.imported = true;
+		node.output = output;
+		node.framebuffer = framebuffer;
+		node.texture = texture;
+		node.desc.width = width;
+		node.desc.height = height;
+		resources.push_back(node);
+		dirty = true;
+		return (Resource)resources.size() - 1;
+	}
+
+	// the owner of an imported target recreated or resized it
+	void setTarget(Resource r, GLuint framebuffer, GLuint texture, int width, int height)
+	{
+		ResourceNode& node = resources[r];
+		node.framebuffer = framebuffer;
+		node.texture = texture;
+		node.desc.width = width;
+		node.desc.height = height;
+	}
+
+	void setTextureSize(Resource r, int width, int height)
+	{
+		ResourceNode& node = resources[r];
+		if (node.desc.width != width || node.desc.height != height) {
+			node.desc.width = width;
+			node.desc.height = height;
+			dirty = true;
+		}
+	}
+
+	Pass addPass(const char* name, std::function<void()> execute)
+	{
+		PassNode node;
+		node.name = name;
+		node.label = name;
+		node.execute = execute;
+		passes.push_back(node);
+		dirty = true;
+		return (Pass)passes.size() - 1;
+	}
+
+	void read(Pass p, Resource r)
+	{
+		passes[p].reads.push_back(r);
+		dirty = true;
+	}
+
+	void write(Pass p, Resource r)
+	{
+		passes[p].writes.push_back(r);
+		dirty = true;
+	}
+
+	// buffers to clear when the pass binds its target
+	void setClear(Pass p, GLbitfield mask)
+	{
+		passes[p].clear = mask;
+	}
+
+	void setEnabled(Pass p, bool enabled)
+	{
+		passes[p].enabled = enabled;
+	}
+
+	bool isCulled(Pass p) const
+	{
+		return passes[p].culled;
+	}
+
+	// the name as given to addPass (the same pointer every time)
+	const char* getName(Pass p) const
+	{
+		return passes[p].label;
+	}
+
+	// texture behind a resource - for transient ones only valid after compile
+	GLuint getTexture(Resource r) const
+	{
+		return resources[r].texture;
+	}
+
+	// called right before (begin) and after every pass that runs - for
+	// timing them from the outside
+	void setPassHook(std::function<void(Pass, bool begin)> hook)
+	{
+		passHook = hook;
+	}
+
+	// passes that survived culling, in execution order
+	const std::vector<Pass>& getOrder() const
+	{
+		return order;
+	}
+
+	// order and textures for the passes enabled now. execute() does it
+	// too, call it first to get at the transient textures before that
+	void compile()
+	{
+		if (dirty) {
+			compiled.clear();
+			current = -1;
+			// (a deleted texture's name can come back for a new one)
+			for (PassNode& pass : passes)
+				pass.attached.clear();
+		}
+		unsigned long long mask = enabledMask();
+		if (current >= 0 && compiled[current].enabled == mask)
+			return;
+		for (size_t i = 0; i < compiled.size(); i++)
+			if (compiled[i].enabled == mask) {
+				restore((int)i);
+				return;
+			}
+
+		cull();
+		sort();
+		allocate(dirty);
+		dirty = false;
+
+		Compiled entry;
+		entry.enabled = mask;
+		entry.culled = 0;
+		for (size_t p = 0; p < passes.size(); p++)
+			if (passes[p].culled)
+				entry.culled |= 1ull << p;
+		entry.order = order;
+		for (const ResourceNode& res : resources)
+			entry.poolIndex.push_back(res.poolIndex);
+		compiled.push_back(entry);
+		current = (int)compiled.size() - 1;
+	}
+
+	void execute()
+	{
+		compile();
+
+		for (Pass p : order) {
+			PassNode& pass = passes[p];
+			if (passHook)
+				passHook(p, true);
+			bindTarget(pass);
+			if (pass.clear)
+				glClear(pass.clear);
+			{
+				PROFILE_ZONE(pass.label);
+				pass.execute();
+			}
+			if (passHook)
+				passHook(p, false);
+		}
+
+		// whatever draws after the graph (the overlay) finds the output
+		// bound, with its viewport - nobody has to save and restore one
+		for (const ResourceNode& res : resources)
+			if (res.imported && res.output) {
+				glBindFramebuffer(GL_FRAMEBUFFER, res.framebuffer);
+				glViewport(0, 0, res.desc.width, res.desc.height);
+				break;
+			}
+	}
+
+	void cleanUp()
+	{
+		for (PassNode& pass : passes) {
+			if (pass.framebuffer) {
+				glDeleteFramebuffers(1, &pass.framebuffer);
+				pass.framebuffer = 0;
+			}
+			pass.attached.clear();
+		}
+		for (PoolEntry& entry : pool)
+			glDeleteTextures(1, &entry.texture);
+		pool.clear();
+		for (ResourceNode& res : resources)
+			res.poolIndex = -1;
+		dirty = true;
+	}
+
+private:
+	struct ResourceNode
+	{
+		std::string name;
+		bool imported = false;
+		bool output = false;
+		TextureDesc desc = { 0, 0, GL_RGB8 };
+		GLuint framebuffer = 0;
+		GLuint texture = 0;
+
+		// compile state
+		int refCount = 0;
+		int first = -1;
+		int last = -1;
+		int poolIndex = -1;
+		int preferred = -1;		// pool entry of the last compile
+	};
+
+	struct PassNode
+	{
+		std::string name;
+		const char* label;		// name as given, for the CPU profiler
+		std::function<void()> execute;
+		std::vector<Resource> reads;
+		std::vector<Resource> writes;
+		GLbitfield clear = 0;
+		bool enabled = true;
+
+		// compile state
+		bool culled = false;
+		int refCount = 0;
+		int inDegree = 0;
+		GLuint framebuffer = 0;		// for passes writing transient textures
+		std::vector<GLuint> attached;	// what is attached to it, by write
+	};
+
+	struct PoolEntry
+	{
+		TextureDesc desc;
+		GLuint texture;
+		bool inUse;
+		bool used;
+	};
+
+	// what compile() worked out for one set of enabled passes
+	struct Compiled
+	{
+		unsigned long long enabled;
+		unsigned long long culled;
+		std::vector<Pass> order;
+		std::vector<int> poolIndex;		// by resource
+	};
+
+	static bool contains(const std::vector<Resource>& list, Resource r)
+	{
+		for (Resource x : list)
+			if (x == r)
+				return true;
+		return false;
+	}
+
+	static bool isDepthFormat(GLenum format)
+	{
+		return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 ||
+			format == GL_DEPTH_COMPONENT32 || format == GL_DEPTH_COMPONENT32F ||
+			format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+	}
+
+	unsigned long long enabledMask() const
+	{
+		unsigned long long mask = 0;
+		for (size_t p = 0; p < passes.size() && p < 64; p++)
+			if (passes[p].enabled)
+				mask |= 1ull << p;
+		return mask;
+	}
+
+	// back to a set of enabled passes compiled before
+	void restore(int index)
+	{
+		const Compiled& entry = compiled[index];
+		current = index;
+		order = entry.order;
+		for (size_t p = 0; p < passes.size(); p++)
+			passes[p].culled = ((entry.culled >> p) & 1) != 0;
+		for (size_t r = 0; r < resources.size(); r++) {
+			ResourceNode& res = resources[r];
+			if (res.imported)
+				continue;
+			res.poolIndex = entry.poolIndex[r];
+			res.texture = res.poolIndex >= 0 ? pool[res.poolIndex].texture : 0;
+		}
+		for (Pass p : order)
+			attach(passes[p]);
+	}
+
+	// must pass i run before pass j?
+	bool runsBefore(Pass i, Pass j) const
+	{
+		const PassNode& a = passes[i];
+		const PassNode& b = passes[j];
+		for (Resource r : a.writes) {
+			if (contains(b.writes, r)) {
+				// two writers of the same thing keep the order they were added in
+				if (i < j)
+					return true;
+			}
+			else if (contains(b.reads, r))
+				return true;
+		}
+		return false;
+	}
+
+	// walk back from the outputs - a pass nobody reads from goes away, and
+	// so may the passes that only fed it
+	void cull()
+	{
+		for (ResourceNode& res : resources)
+			res.refCount = res.output ? 1 : 0;
+
+		for (PassNode& pass : passes) {
+			pass.culled = !pass.enabled;
+			pass.refCount = 0;
+			if (pass.culled)
+				continue;
+			pass.refCount = (int)pass.writes.size();
+			for (Resource r : pass.reads)
+				resources[r].refCount++;
+		}
+
+		stack.clear();
+		for (size_t r = 0; r < resources.size(); r++)
+			if (resources[r].refCount == 0)
+				stack.push_back((Resource)r);
+
+		for (PassNode& pass : passes)
+			if (!pass.culled && pass.refCount == 0)
+				cullPass(pass);
+
+		while (!stack.empty()) {
+			Resource r = stack.back();
+			stack.pop_back();
+			for (PassNode& pass : passes)
+				if (!pass.culled && contains(pass.writes, r) && --pass.refCount == 0)
+					cullPass(pass);
+		}
+	}
+
+	void cullPass(PassNode& pass)
+	{
+		pass.culled = true;
+		for (Resource r : pass.reads)
+			if (--resources[r].refCount == 0)
+				stack.push_back(r);
+	}
+
+	// topological order of the surviving passes, ties broken by the order
+	// they were added in
+	void sort()
+	{
+		order.clear();
+		size_t live = 0;
+		for (size_t j = 0; j < passes.size(); j++) {
+			passes[j].inDegree = 0;
+			if (passes[j].culled)
+				continue;
+			live++;
+			for (size_t i = 0; i < passes.size(); i++)
+				if (i != j && !passes[i].culled && runsBefore((Pass)i, (Pass)j))
+					passes[j].inDegree++;
+		}
+
+		while (order.size() < live) {
+			Pass next = -1;
+			for (size_t p = 0; p < passes.size(); p++)
+				if (!passes[p].culled && passes[p].inDegree == 0) {
+					next = (Pass)p;
+					break;
+				}
+
+			if (next < 0) {
+				// a cycle - fall back to the order the passes were added in
+				std::cout << "FrameGraph: dependency cycle, using declaration order" << std::endl;
+				order.clear();
+				for (size_t p = 0; p < passes.size(); p++)
+					if (!passes[p].culled)
+						order.push_back((Pass)p);
+				return;
+			}
+
+			order.push_back(next);
+			passes[next].inDegree = -1;
+			for (size_t j = 0; j < passes.size(); j++)
+				if (!passes[j].culled && passes[j].inDegree > 0 && runsBefore(next, (Pass)j))
+					passes[j].inDegree--;
+		}
+	}
+
+	// give every transient texture a pooled texture for the span of passes
+	// that use it; textures free again afterwards can be reused. the other
+	// sets of passes compiled keep their textures, unless the graph changed
+	// (reclaim) - then whatever this set doesn't use goes
+	void allocate(bool reclaim)
+	{
+		for (ResourceNode& res : resources) {
+			res.first = res.last = -1;
+			if (!res.imported) {
+				res.preferred = reclaim ? -1 : res.poolIndex;
+				res.poolIndex = -1;
+				res.texture = 0;
+			}
+		}
+
+		for (size_t idx = 0; idx < order.size(); idx++) {
+			const PassNode& pass = passes[order[idx]];
+			for (int k = 0; k < 2; k++)
+				for (Resource r : (k ? pass.writes : pass.reads)) {
+					ResourceNode& res = resources[r];
+					if (res.first < 0)
+						res.first = (int)idx;
+					res.last = (int)idx;
+				}
+		}
+
+		for (PoolEntry& entry : pool) {
+			entry.inUse = false;
+			if (reclaim)
+				entry.used = false;
+		}
+
+		for (size_t idx = 0; idx < order.size(); idx++) {
+			for (ResourceNode& res : resources)
+				if (!res.imported && res.first == (int)idx)
+					acquire(res);
+			for (ResourceNode& res : resources)
+				if (!res.imported && res.last == (int)idx)
+					pool[res.poolIndex].inUse = false;
+		}
+
+		// anything the pool didn't hand out this time is no longer needed
+		for (size_t i = pool.size(); reclaim && i-- > 0; )
+			if (!pool[i].used) {
+				glDeleteTextures(1, &pool[i].texture);
+				pool.erase(pool.begin() + i);
+				for (ResourceNode& res : resources)
+					if (res.poolIndex > (int)i)
+						res.poolIndex--;
+			}
+
+		for (Pass p : order)
+			attach(passes[p]);
+	}
+
+	void acquire(ResourceNode& res)
+	{
+		// the texture it had, so switching between sets of passes mostly
+		// leaves the framebuffers as they are
+		int i = res.preferred;
+		if (i >= 0 && i < (int)pool.size() && !pool[i].inUse && pool[i].desc == res.desc) {
+			pool[i].inUse = pool[i].used = true;
+			res.poolIndex = i;
+			res.texture = pool[i].texture;
+			return;
+		}
+
+		for (size_t i = 0; i < pool.size(); i++)
+			if (!pool[i].inUse && pool[i].desc == res.desc) {
+				pool[i].inUse = pool[i].used = true;
+				res.poolIndex = (int)i;
+				res.texture = pool[i].texture;
+				return;
+			}
+
+		PoolEntry entry;
+		entry.desc = res.desc;
+		entry.inUse = entry.used = true;
+		GpuMemory::Owner owner("frame graph");
+		glGenTextures(1, &entry.texture);
+		glBindTexture(GL_TEXTURE_2D, entry.texture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, res.desc.internalFormat, res.desc.width, res.desc.height);
+		GLint filter = isDepthFormat(res.desc.internalFormat) ? GL_NEAREST : GL_LINEAR;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		pool.push_back(entry);
+
+		res.poolIndex = (int)pool.size() - 1;
+		res.texture = entry.texture;
+	}
+
+	// point the pass' framebuffer at the textures it writes this time
+	// (if they aren't the ones it already has)
+	void attach(PassNode& pass)
+	{
+		bool changed = false;
+		pass.attached.resize(pass.writes.size());
+		for (size_t w = 0; w < pass.writes.size(); w++) {
+			const ResourceNode& res = resources[pass.writes[w]];
+			if (!res.imported && pass.attached[w] != res.texture) {
+				pass.attached[w] = res.texture;
+				changed = true;
+			}
+		}
+		if (!changed)
+			return;
+
+		if (!pass.framebuffer)
+			glGenFramebuffers(1, &pass.framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+
+		GLenum drawBuffers[8];
+		GLsizei colorCount = 0;
+		for (Resource r : pass.writes) {
+			const ResourceNode& res = resources[r];
+			if (res.imported)
+				continue;
+			if (isDepthFormat(res.desc.internalFormat)) {
+				GLenum attachment = (res.desc.internalFormat == GL_DEPTH24_STENCIL8 ||
+					res.desc.internalFormat == GL_DEPTH32F_STENCIL8) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+				glFramebufferTexture(GL_FRAMEBUFFER, attachment, res.texture, 0);
+			}
+			else if (colorCount < 8) {
+				drawBuffers[colorCount] = GL_COLOR_ATTACHMENT0 + colorCount;
+				glFramebufferTexture(GL_FRAMEBUFFER, drawBuffers[colorCount], res.texture, 0);
+				colorCount++;
+			}
+		}
+		if (colorCount)
+			glDrawBuffers(colorCount, drawBuffers);
+		else
+			glDrawBuffer(GL_NONE);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "FrameGraph: framebuffer of pass " << pass.name << " is incomplete" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// every pass starts with its target bound and the viewport covering
+	// it
+	void bindTarget(const PassNode& pass)
+	{
+		if (pass.framebuffer) {
+			for (Resource r : pass.writes)
+				if (!resources[r].imported) {
+					glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+					glViewport(0, 0, resources[r].desc.width, resources[r].desc.height);
+					return;
+				}
+		}
+		for (Resource r : pass.writes)
+			if (resources[r].imported) {
+				const ResourceNode& res = resources[r];
+				glBindFramebuffer(GL_FRAMEBUFFER, res.framebuffer);
+				glViewport(0, 0, res.desc.width, res.desc.height);
+				return;
+			}
+	}
+
+	std::vector<ResourceNode> resources;
+	std::vector<PassNode> passes;
+	std::vector<PoolEntry> pool;
+
+	std::vector<Pass> order;
+	std::vector<Resource> stack;
+	std::vector<Compiled> compiled;
+	int current = -1;		// the one in order
+	bool dirty = true;
+	std::function<void(Pass, bool)> passHook;
+};
@@ -0,0 +1,811 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+// What the renderer has allocated on the GPU, by category and by owner.
+//
+// Like DrawStats it swaps glad's entry points, here the ones that make,
+// size and delete textures, buffers, renderbuffers and framebuffers, so
+// every allocation is accounted for without the call sites knowing.
+// install() has to run after glad is loaded - loading it again puts the
+// real ones back.
+//
+// The storage calls act on whatever is bound, so the bind calls are swapped
+// too and keep track of that - asking GL (glGetIntegerv) for every
+// glBufferData or glTexImage2D could wait for the driver. A binding is only
+// asked for when it isn't known: the ones from before install(), and the
+// element buffer after a vertex array was bound (it belongs to the array).
+//
+// The owner of an object is whoever was in scope when it was made (or,
+// failing that, when its storage was):
+//
+//	{
+//		GpuMemory::Owner owner("heightmaps");
+//		...glGenTextures, glTexImage2D...
+//	}
+//
+// Textures attached to a framebuffer count as render targets. The sizes
+// are what the storage takes in the formats asked for - drivers pad some
+// (RGB8 is counted as four bytes a texel, as they store it).
+//
+// frame() once a frame logs a line (to stderr) every LOG_INTERVAL frames,
+// and at once whenever the total moved by more than LOG_CHANGE since the
+// last line. report() at shutdown lists what is still alive, and what of
+// it was made after the first frame - where leaks show up.
+//
+// Only for the GL thread, and one context at a time.
+class GpuMemory
+{
+public:
+	enum Category
+	{
+		TEXTURES,
+		RENDER_TARGETS,
+		GEOMETRY,			// vertex and index buffers
+		UNIFORMS,			// uniform and shader storage buffers
+		TRANSFER,			// pixel pack / unpack buffers
+		OTHER_BUFFERS,
+		CATEGORY_COUNT
+	};
+
+	static const unsigned int LOG_INTERVAL = 600;
+	static const size_t LOG_CHANGE = 1 << 20;
+
+	struct Usage
+	{
+		std::string owner;
+		Category category;
+		size_t bytes = 0;
+		unsigned int objects = 0;
+	};
+
+	class Owner
+	{
+	public:
+		explicit Owner(const char* name)
+			: previous(state().owner)
+		{
+			state().owner = name;
+		}
+
+		~Owner()
+		{
+			state().owner = this->previous;
+		}
+
+	private:
+		const char* previous;
+	};
+
+	static void install()
+	{
+		State& s = state();
+		if (glad_glGenTextures == genTextures)
+			return;
+		s.genTextures = glad_glGenTextures;
+		s.deleteTextures = glad_glDeleteTextures;
+		s.texImage2D = glad_glTexImage2D;
+		s.texImage3D = glad_glTexImage3D;
+		s.texStorage2D = glad_glTexStorage2D;
+		s.texStorage3D = glad_glTexStorage3D;
+		s.generateMipmap = glad_glGenerateMipmap;
+		s.genBuffers = glad_glGenBuffers;
+		s.deleteBuffers = glad_glDeleteBuffers;
+		s.bufferData = glad_glBufferData;
+		s.bufferStorage = glad_glBufferStorage;
+		s.genRenderbuffers = glad_glGenRenderbuffers;
+		s.deleteRenderbuffers = glad_glDeleteRenderbuffers;
+		s.renderbufferStorage = glad_glRenderbufferStorage;
+		s.renderbufferStorageMultisample = glad_glRenderbufferStorageMultisample;
+		s.genFramebuffers = glad_glGenFramebuffers;
+		s.deleteFramebuffers = glad_glDeleteFramebuffers;
+		s.framebufferTexture = glad_glFramebufferTexture;
+		s.framebufferTexture2D = glad_glFramebufferTexture2D;
+		s.framebufferTextureLayer = glad_glFramebufferTextureLayer;
+		s.activeTexture = glad_glActiveTexture;
+		s.bindTexture = glad_glBindTexture;
+		s.bindBuffer = glad_glBindBuffer;
+		s.bindBufferBase = glad_glBindBufferBase;
+		s.bindBufferRange = glad_glBindBufferRange;
+		s.bindRenderbuffer = glad_glBindRenderbuffer;
+		s.bindVertexArray = glad_glBindVertexArray;
+		s.deleteVertexArrays = glad_glDeleteVertexArrays;
+
+		// whatever is bound now isn't known yet
+		for (GLint(&unit)[TEXTURE_TARGETS] : s.boundTextures)
+			for (GLint& name : unit)
+				name = UNKNOWN;
+		for (GLint& name : s.boundBuffers)
+			name = UNKNOWN;
+		s.boundRenderbuffer = UNKNOWN;
+		GLint unit = GL_TEXTURE0;
+		glGetIntegerv(GL_ACTIVE_TEXTURE, &unit);
+		s.activeUnit = unit - GL_TEXTURE0;
+
+		glad_glGenTextures = genTextures;
+		glad_glDeleteTextures = deleteTextures;
+		glad_glTexImage2D = texImage2D;
+		glad_glTexImage3D = texImage3D;
+		glad_glTexStorage2D = texStorage2D;
+		glad_glTexStorage3D = texStorage3D;
+		glad_glGenerateMipmap = generateMipmap;
+		glad_glGenBuffers = genBuffers;
+		glad_glDeleteBuffers = deleteBuffers;
+		glad_glBufferData = bufferData;
+		glad_glBufferStorage = s.bufferStorage ? bufferStorage : nullptr;
+		glad_glGenRenderbuffers = genRenderbuffers;
+		glad_glDeleteRenderbuffers = deleteRenderbuffers;
+		glad_glRenderbufferStorage = renderbufferStorage;
+		glad_glRenderbufferStorageMultisample = renderbufferStorageMultisample;
+		glad_glGenFramebuffers = genFramebuffers;
+		glad_glDeleteFramebuffers = deleteFramebuffers;
+		glad_glFramebufferTexture = framebufferTexture;
+		glad_glFramebufferTexture2D = framebufferTexture2D;
+		glad_glFramebufferTextureLayer = framebufferTextureLayer;
+		glad_glActiveTexture = activeTexture;
+		glad_glBindTexture = bindTexture;
+		glad_glBindBuffer = bindBuffer;
+		glad_glBindBufferBase = bindBufferBase;
+		glad_glBindBufferRange = bindBufferRange;
+		glad_glBindRenderbuffer = bindRenderbuffer;
+		glad_glBindVertexArray = bindVertexArray;
+		glad_glDeleteVertexArrays = deleteVertexArrays;
+	}
+
+	static const char* categoryName(Category category)
+	{
+		static const char* names[CATEGORY_COUNT] = {
+			"textures", "render targets", "geometry", "uniforms", "transfer", "other buffers"
+		};
+		return names[category];
+	}
+
+	//************************************************************************
+	//
+	// * The live numbers
+	//========================================================================
+	static size_t bytes(Category category)
+	{
+		return state().totals[category];
+	}
+
+	static size_t totalBytes()
+	{
+		size_t total = 0;
+		for (int i = 0; i < CATEGORY_COUNT; i++)
+			total += state().totals[i];
+		return total;
+	}
+
+	static unsigned int framebuffers()
+	{
+		return (unsigned int)state().framebuffers.size();
+	}
+
+	// bytes and objects by owner and category, the largest first
+	static std::vector<Usage> usage(bool sinceFirstFrame = false)
+	{
+		std::map<std::pair<std::string, int>, Usage> groups;
+		const State& s = state();
+		const std::map<GLuint, Allocation>* kinds[] = { &s.textures, &s.buffers, &s.renderbuffers };
+		for (const std::map<GLuint, Allocation>* kind : kinds)
+			for (const std::pair<const GLuint, Allocation>& object : *kind) {
+				const Allocation& allocation = object.second;
+				if (sinceFirstFrame && allocation.frame == 0)
+					continue;
+				Usage& group = groups[std::make_pair(std::string(allocation.owner), (int)allocation.category)];
+				group.owner = allocation.owner;
+				group.category = allocation.category;
+				group.bytes += allocation.bytes;
+				group.objects++;
+			}
+
+		std::vector<Usage> list;
+		for (const std::pair<const std::pair<std::string, int>, Usage>& group : groups)
+			list.push_back(group.second);
+		std::sort(list.begin(), list.end(), [](const Usage& a, const Usage& b) { return a.bytes > b.bytes; });
+		return list;
+	}
+
+	// once a frame
+	static void frame()
+	{
+		State& s = state();
+		s.frame++;
+		size_t total = totalBytes();
+		size_t change = total > s.logged ? total - s.logged : s.logged - total;
+		if (s.frame % LOG_INTERVAL == 0 || change > LOG_CHANGE) {
+			long long delta = (long long)total - (long long)s.logged;
+			fprintf(stderr, "GPU memory: %.1f MB (%+.1f MB) -", total / 1048576.0, delta / 1048576.0);
+			for (int i = 0; i < CATEGORY_COUNT; i++)
+				if (s.totals[i])
+					fprintf(stderr, " %s %.1f", categoryName((Category)i), s.totals[i] / 1048576.0);
+			fprintf(stderr, "\n");
+			s.logged = total;
+		}
+	}
+
+	// what is still alive, by owner - at shutdown, whatever wasn't freed
+	static void report(FILE* file)
+	{
+		const State& s = state();
+		unsigned int objects = 0;
+		std::vector<Usage> alive = usage();
+		for (const Usage& group : alive)
+			objects += group.objects;
+		fprintf(file, "GPU memory still allocated: %.1f MB in %u objects, %u framebuffers\n",
+			totalBytes() / 1048576.0, objects, (unsigned int)s.framebuffers.size());
+		for (const Usage& group : alive)
+			fprintf(file, "  %-20s %-14s %5u %10.2f MB\n", group.owner.c_str(), categoryName(group.category),
+				group.objects, group.bytes / 1048576.0);
+
+		// the first frame makes everything that lives as long as the
+		// program. what came after and is still here is worth a look
+		std::vector<Usage> later = usage(true);
+		if (later.empty())
+			return;
+		fprintf(file, "made after the first frame and never freed:\n");
+		for (const Usage& group : later)
+			fprintf(file, "  %-20s %-14s %5u %10.2f MB\n", group.owner.c_str(), categoryName(group.category),
+				group.objects, group.bytes / 1048576.0);
+	}
+
+private:
+	static const GLint UNKNOWN = -1;
+	static const int TEXTURE_UNITS = 32;		// tracked - above that GL is asked
+	static const int TEXTURE_TARGETS = 6;
+	static const int BUFFER_TARGETS = 10;
+
+	struct Allocation
+	{
+		const char* owner = "other";
+		Category category = OTHER_BUFFERS;
+		size_t bytes = 0;
+		unsigned int frame = 0;
+		// textures: the size of every image (level * 6 + face), and of level 0
+		std::map<int, size_t> images;
+		GLenum format = 0;
+		GLsizei width = 0, height = 0, depth = 0;
+		bool volume = false;	// 3D - the depth halves with the levels too
+		int faces = 1;
+	};
+
+	struct State
+	{
+		PFNGLGENTEXTURESPROC genTextures;
+		PFNGLDELETETEXTURESPROC deleteTextures;
+		PFNGLTEXIMAGE2DPROC texImage2D;
+		PFNGLTEXIMAGE3DPROC texImage3D;
+		PFNGLTEXSTORAGE2DPROC texStorage2D;
+		PFNGLTEXSTORAGE3DPROC texStorage3D;
+		PFNGLGENERATEMIPMAPPROC generateMipmap;
+		PFNGLGENBUFFERSPROC genBuffers;
+		PFNGLDELETEBUFFERSPROC deleteBuffers;
+		PFNGLBUFFERDATAPROC bufferData;
+		PFNGLBUFFERSTORAGEPROC bufferStorage;
+		PFNGLGENRENDERBUFFERSPROC genRenderbuffers;
+		PFNGLDELETERENDERBUFFERSPROC deleteRenderbuffers;
+		PFNGLRENDERBUFFERSTORAGEPROC renderbufferStorage;
+		PFNGLRENDERBUFFERSTORAGEMULTISAMPLEPROC renderbufferStorageMultisample;
+		PFNGLGENFRAMEBUFFERSPROC genFramebuffers;
+		PFNGLDELETEFRAMEBUFFERSPROC deleteFramebuffers;
+		PFNGLFRAMEBUFFERTEXTUREPROC framebufferTexture;
+		PFNGLFRAMEBUFFERTEXTURE2DPROC framebufferTexture2D;
+		PFNGLFRAMEBUFFERTEXTURELAYERPROC framebufferTextureLayer;
+		PFNGLACTIVETEXTUREPROC activeTexture;
+		PFNGLBINDTEXTUREPROC bindTexture;
+		PFNGLBINDBUFFERPROC bindBuffer;
+		PFNGLBINDBUFFERBASEPROC bindBufferBase;
+		PFNGLBINDBUFFERRANGEPROC bindBufferRange;
+		PFNGLBINDRENDERBUFFERPROC bindRenderbuffer;
+		PFNGLBINDVERTEXARRAYPROC bindVertexArray;
+		PFNGLDELETEVERTEXARRAYSPROC deleteVertexArrays;
+
+		// what is bound, by textureBindings() / bufferBindings()
+		int activeUnit = 0;
+		GLint boundTextures[TEXTURE_UNITS][TEXTURE_TARGETS];
+		GLint boundBuffers[BUFFER_TARGETS];
+		GLint boundRenderbuffer = UNKNOWN;
+
+		std::map<GLuint, Allocation> textures;
+		std::map<GLuint, Allocation> buffers;
+		std::map<GLuint, Allocation> renderbuffers;
+		std::map<GLuint, const char*> framebuffers;
+		size_t totals[CATEGORY_COUNT] = {};
+
+		const char* owner = nullptr;
+		unsigned int frame = 0;
+		size_t logged = 0;
+	};
+
+	static State& state()
+	{
+		static State s;
+		return s;
+	}
+
+	static const char* owner()
+	{
+		return state().owner ? state().owner : "other";
+	}
+
+	static void made(std::map<GLuint, Allocation>& objects, GLsizei n, const GLuint* names, Category category)
+	{
+		for (GLsizei i = 0; i < n; i++) {
+			Allocation& allocation = objects[names[i]];
+			setBytes(allocation, 0);
+			allocation = Allocation();
+			allocation.owner = owner();
+			allocation.category = category;
+			allocation.frame = state().frame;
+		}
+	}
+
+	static void freed(std::map<GLuint, Allocation>& objects, GLsizei n, const GLuint* names)
+	{
+		for (GLsizei i = 0; i < n; i++) {
+			std::map<GLuint, Allocation>::iterator object = objects.find(names[i]);
+			if (object == objects.end())
+				continue;
+			setBytes(object->second, 0);
+			objects.erase(object);
+		}
+	}
+
+	// the object bound to target, made if it came from before install.
+	// slot is where the bind hooks keep it - only asked for if they don't
+	// know (or there is no slot for it)
+	static Allocation* bound(std::map<GLuint, Allocation>& objects, GLint* slot, GLenum binding, Category category)
+	{
+		GLint name = 0;
+		if (slot && *slot != UNKNOWN)
+			name = *slot;
+		else if (binding) {
+			glGetIntegerv(binding, &name);
+			if (slot)
+				*slot = name;
+		}
+		if (name <= 0)
+			return nullptr;
+		std::map<GLuint, Allocation>::iterator object = objects.find((GLuint)name);
+		if (object == objects.end()) {
+			GLuint id = (GLuint)name;
+			made(objects, 1, &id, category);
+			object = objects.find(id);
+		}
+		// storage made in someone's scope for an object that had none
+		if (state().owner && !strcmp(object->second.owner, "other"))
+			object->second.owner = state().owner;
+		return &object->second;
+	}
+
+	// index of binding in a list of them, -1 if it isn't there
+	static int find(const GLenum* bindings, int count, GLenum binding)
+	{
+		for (int i = 0; i < count; i++)
+			if (bindings[i] == binding)
+				return i;
+		return -1;
+	}
+
+	// a deleted object is unbound wherever it was bound
+	static void unbind(GLint* slots, int count, GLsizei n, const GLuint* names)
+	{
+		for (int i = 0; i < count; i++)
+			for (GLsizei j = 0; j < n; j++)
+				if (slots[i] == (GLint)names[j])
+					slots[i] = 0;
+	}
+
+	static void setBytes(Allocation& allocation, size_t bytes)
+	{
+		size_t& total = state().totals[allocation.category];
+		total = total - allocation.bytes + bytes;
+		allocation.bytes = bytes;
+	}
+
+	static void setCategory(Allocation& allocation, Category category)
+	{
+		size_t bytes = allocation.bytes;
+		setBytes(allocation, 0);
+		allocation.category = category;
+		setBytes(allocation, bytes);
+	}
+
+	//************************************************************************
+	//
+	// * Textures
+	//========================================================================
+	static size_t texelBytes(GLenum format)
+	{
+		switch (format) {
+		case GL_R8: case GL_RED: case GL_STENCIL_INDEX8:
+			return 1;
+		case GL_RG8: case GL_RG: case GL_R16F: case GL_DEPTH_COMPONENT16:
+			return 2;
+		case GL_RG32F: case GL_RGBA16F: case GL_DEPTH32F_STENCIL8:
+			return 8;
+		case GL_RGB32F:
+			return 12;
+		case GL_RGBA32F:
+			return 16;
+		default:	// RGB8 (padded), RGBA8, 32 bit depth, R32F, R32UI...
+			return 4;
+		}
+	}
+
+	static GLenum textureBinding(GLenum target)
+	{
+		switch (target) {
+		case GL_TEXTURE_2D: return GL_TEXTURE_BINDING_2D;
+		case GL_TEXTURE_2D_ARRAY: return GL_TEXTURE_BINDING_2D_ARRAY;
+		case GL_TEXTURE_3D: return GL_TEXTURE_BINDING_3D;
+		case GL_TEXTURE_1D_ARRAY: return GL_TEXTURE_BINDING_1D_ARRAY;
+		case GL_TEXTURE_RECTANGLE: return GL_TEXTURE_BINDING_RECTANGLE;
+		case GL_TEXTURE_CUBE_MAP:
+		case GL_TEXTURE_CUBE_MAP_POSITIVE_X: case GL_TEXTURE_CUBE_MAP_NEGATIVE_X:
+		case GL_TEXTURE_CUBE_MAP_POSITIVE_Y: case GL_TEXTURE_CUBE_MAP_NEGATIVE_Y:
+		case GL_TEXTURE_CUBE_MAP_POSITIVE_Z: case GL_TEXTURE_CUBE_MAP_NEGATIVE_Z:
+			return GL_TEXTURE_BINDING_CUBE_MAP;
+		default:
+			return 0;	// proxies and the rest aren't storage
+		}
+	}
+
+	static const GLenum* textureBindings()
+	{
+		static const GLenum bindings[TEXTURE_TARGETS] = {
+			GL_TEXTURE_BINDING_2D, GL_TEXTURE_BINDING_2D_ARRAY, GL_TEXTURE_BINDING_3D,
+			GL_TEXTURE_BINDING_1D_ARRAY, GL_TEXTURE_BINDING_RECTANGLE, GL_TEXTURE_BINDING_CUBE_MAP
+		};
+		return bindings;
+	}
+
+	// where the texture bound to binding on the active unit is kept
+	static GLint* textureSlot(GLenum binding)
+	{
+		State& s = state();
+		int target = find(textureBindings(), TEXTURE_TARGETS, binding);
+		if (target < 0 || s.activeUnit < 0 || s.activeUnit >= TEXTURE_UNITS)
+			return nullptr;
+		return &s.boundTextures[s.activeUnit][target];
+	}
+
+	static bool isCubeFace(GLenum target)
+	{
+		return target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z;
+	}
+
+	static void setImage(Allocation& texture, int level, int face, size_t bytes)
+	{
+		size_t& image = texture.images[level * 6 + face];
+		size_t total = texture.bytes - image + bytes;
+		image = bytes;
+		setBytes(texture, total);
+	}
+
+	static size_t levelBytes(const Allocation& texture, int level)
+	{
+		size_t w = texture.width >> level ? texture.width >> level : 1;
+		size_t h = texture.height >> level ? texture.height >> level : 1;
+		size_t d = texture.volume ? (texture.depth >> level ? texture.depth >> level : 1) : texture.depth;
+		return w * h * d * texelBytes(texture.format);
+	}
+
+	static void image(GLenum target, GLint level, GLint format, GLsizei width, GLsizei height, GLsizei depth)
+	{
+		GLenum binding = textureBinding(target);
+		Allocation* texture = bound(state().textures, textureSlot(binding), binding, TEXTURES);
+		if (!texture)
+			return;
+		if (level == 0) {
+			texture->format = format;
+			texture->width = width;
+			texture->height = height;
+			texture->depth = depth;
+			texture->volume = target == GL_TEXTURE_3D;
+		}
+		int face = 0;
+		if (isCubeFace(target)) {
+			texture->faces = 6;
+			face = target - GL_TEXTURE_CUBE_MAP_POSITIVE_X;
+		}
+		setImage(*texture, level, face, (size_t)width * height * depth * texelBytes(format));
+	}
+
+	static void storage(GLenum target, GLsizei levels, GLenum format, GLsizei width, GLsizei height, GLsizei depth)
+	{
+		GLenum binding = textureBinding(target);
+		Allocation* texture = bound(state().textures, textureSlot(binding), binding, TEXTURES);
+		if (!texture)
+			return;
+		texture->format = format;
+		texture->width = width;
+		texture->height = height;
+		texture->depth = depth;
+		texture->volume = target == GL_TEXTURE_3D;
+		texture->faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+		for (int level = 0; level < levels; level++)
+			for (int face = 0; face < texture->faces; face++)
+				setImage(*texture, level, face, levelBytes(*texture, level));
+	}
+
+	static void APIENTRY genTextures(GLsizei n, GLuint* textures)
+	{
+		state().genTextures(n, textures);
+		made(state().textures, n, textures, TEXTURES);
+	}
+
+	static void APIENTRY deleteTextures(GLsizei n, const GLuint* textures)
+	{
+		state().deleteTextures(n, textures);
+		freed(state().textures, n, textures);
+		unbind(&state().boundTextures[0][0], TEXTURE_UNITS * TEXTURE_TARGETS, n, textures);
+	}
+
+	static void APIENTRY activeTexture(GLenum texture)
+	{
+		state().activeTexture(texture);
+		state().activeUnit = (int)(texture - GL_TEXTURE0);
+	}
+
+	static void APIENTRY bindTexture(GLenum target, GLuint texture)
+	{
+		state().bindTexture(target, texture);
+		GLint* slot = textureSlot(textureBinding(target));
+		if (slot)
+			*slot = (GLint)texture;
+	}
+
+	static void APIENTRY texImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height,
+		GLint border, GLenum format, GLenum type, const void* pixels)
+	{
+		state().texImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+		image(target, level, internalformat, width, height, 1);
+	}
+
+	static void APIENTRY texImage3D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height,
+		GLsizei depth, GLint border, GLenum format, GLenum type, const void* pixels)
+	{
+		state().texImage3D(target, level, internalformat, width, height, depth, border, format, type, pixels);
+		image(target, level, internalformat, width, height, depth);
+	}
+
+	static void APIENTRY texStorage2D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width,
+		GLsizei height)
+	{
+		state().texStorage2D(target, levels, internalformat, width, height);
+		storage(target, levels, internalformat, width, height, 1);
+	}
+
+	static void APIENTRY texStorage3D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width,
+		GLsizei height, GLsizei depth)
+	{
+		state().texStorage3D(target, levels, internalformat, width, height, depth);
+		storage(target, levels, internalformat, width, height, depth);
+	}
+
+	static void APIENTRY generateMipmap(GLenum target)
+	{
+		state().generateMipmap(target);
+		GLenum binding = textureBinding(target);
+		Allocation* texture = bound(state().textures, textureSlot(binding), binding, TEXTURES);
+		if (!texture || !texture->width)
+			return;
+		int levels = 1;
+		while ((texture->width | texture->height) >> levels)
+			levels++;
+		for (int level = 1; level < levels; level++)
+			for (int face = 0; face < texture->faces; face++)
+				setImage(*texture, level, face, levelBytes(*texture, level));
+	}
+
+	//************************************************************************
+	//
+	// * Buffers
+	//========================================================================
+	static void bufferBinding(GLenum target, GLenum& binding, Category& category)
+	{
+		switch (target) {
+		case GL_ARRAY_BUFFER: binding = GL_ARRAY_BUFFER_BINDING; category = GEOMETRY; return;
+		case GL_ELEMENT_ARRAY_BUFFER: binding = GL_ELEMENT_ARRAY_BUFFER_BINDING; category = GEOMETRY; return;
+		case GL_UNIFORM_BUFFER: binding = GL_UNIFORM_BUFFER_BINDING; category = UNIFORMS; return;
+		case GL_SHADER_STORAGE_BUFFER: binding = GL_SHADER_STORAGE_BUFFER_BINDING; category = UNIFORMS; return;
+		case GL_PIXEL_PACK_BUFFER: binding = GL_PIXEL_PACK_BUFFER_BINDING; category = TRANSFER; return;
+		case GL_PIXEL_UNPACK_BUFFER: binding = GL_PIXEL_UNPACK_BUFFER_BINDING; category = TRANSFER; return;
+		case GL_COPY_READ_BUFFER: binding = GL_COPY_READ_BUFFER_BINDING; category = OTHER_BUFFERS; return;
+		case GL_COPY_WRITE_BUFFER: binding = GL_COPY_WRITE_BUFFER_BINDING; category = OTHER_BUFFERS; return;
+		case GL_DRAW_INDIRECT_BUFFER: binding = GL_DRAW_INDIRECT_BUFFER_BINDING; category = OTHER_BUFFERS; return;
+		case GL_DISPATCH_INDIRECT_BUFFER: binding = GL_DISPATCH_INDIRECT_BUFFER_BINDING; category = OTHER_BUFFERS; return;
+		default: binding = 0; category = OTHER_BUFFERS; return;
+		}
+	}
+
+	static const GLenum* bufferBindings()
+	{
+		static const GLenum bindings[BUFFER_TARGETS] = {
+			GL_ARRAY_BUFFER_BINDING, GL_ELEMENT_ARRAY_BUFFER_BINDING, GL_UNIFORM_BUFFER_BINDING,
+			GL_SHADER_STORAGE_BUFFER_BINDING, GL_PIXEL_PACK_BUFFER_BINDING, GL_PIXEL_UNPACK_BUFFER_BINDING,
+			GL_COPY_READ_BUFFER_BINDING, GL_COPY_WRITE_BUFFER_BINDING, GL_DRAW_INDIRECT_BUFFER_BINDING,
+			GL_DISPATCH_INDIRECT_BUFFER_BINDING
+		};
+		return bindings;
+	}
+
+	static GLint* bufferSlot(GLenum target)
+	{
+		GLenum binding;
+		Category category;
+		bufferBinding(target, binding, category);
+		int index = find(bufferBindings(), BUFFER_TARGETS, binding);
+		return index < 0 ? nullptr : &state().boundBuffers[index];
+	}
+
+	static void boundBuffer(GLenum target, GLuint buffer)
+	{
+		GLint* slot = bufferSlot(target);
+		if (slot)
+			*slot = (GLint)buffer;
+	}
+
+	// a buffer gets its category from where its storage was made
+	static void bufferBytes(GLenum target, GLsizeiptr size)
+	{
+		GLenum binding;
+		Category category;
+		bufferBinding(target, binding, category);
+		Allocation* buffer = bound(state().buffers, bufferSlot(target), binding, category);
+		if (!buffer)
+			return;
+		setCategory(*buffer, category);
+		setBytes(*buffer, (size_t)size);
+	}
+
+	static void APIENTRY genBuffers(GLsizei n, GLuint* buffers)
+	{
+		state().genBuffers(n, buffers);
+		made(state().buffers, n, buffers, OTHER_BUFFERS);
+	}
+
+	static void APIENTRY deleteBuffers(GLsizei n, const GLuint* buffers)
+	{
+		state().deleteBuffers(n, buffers);
+		freed(state().buffers, n, buffers);
+		unbind(state().boundBuffers, BUFFER_TARGETS, n, buffers);
+	}
+
+	static void APIENTRY bindBuffer(GLenum target, GLuint buffer)
+	{
+		state().bindBuffer(target, buffer);
+		boundBuffer(target, buffer);
+	}
+
+	// the indexed binds bind the target itself too
+	static void APIENTRY bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+	{
+		state().bindBufferBase(target, index, buffer);
+		boundBuffer(target, buffer);
+	}
+
+	static void APIENTRY bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset,
+		GLsizeiptr size)
+	{
+		state().bindBufferRange(target, index, buffer, offset, size);
+		boundBuffer(target, buffer);
+	}
+
+	// the element buffer binding is the vertex array's
+	static void APIENTRY bindVertexArray(GLuint array)
+	{
+		state().bindVertexArray(array);
+		*bufferSlot(GL_ELEMENT_ARRAY_BUFFER) = UNKNOWN;
+	}
+
+	static void APIENTRY deleteVertexArrays(GLsizei n, const GLuint* arrays)
+	{
+		state().deleteVertexArrays(n, arrays);
+		*bufferSlot(GL_ELEMENT_ARRAY_BUFFER) = UNKNOWN;
+	}
+
+	static void APIENTRY bufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+	{
+		state().bufferData(target, size, data, usage);
+		bufferBytes(target, size);
+	}
+
+	static void APIENTRY bufferStorage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags)
+	{
+		state().bufferStorage(target, size, data, flags);
+		bufferBytes(target, size);
+	}
+
+	//************************************************************************
+	//
+	// * Renderbuffers and framebuffers
+	//========================================================================
+	static void APIENTRY genRenderbuffers(GLsizei n, GLuint* renderbuffers)
+	{
+		state().genRenderbuffers(n, renderbuffers);
+		made(state().renderbuffers, n, renderbuffers, RENDER_TARGETS);
+	}
+
+	static void APIENTRY deleteRenderbuffers(GLsizei n, const GLuint* renderbuffers)
+	{
+		state().deleteRenderbuffers(n, renderbuffers);
+		freed(state().renderbuffers, n, renderbuffers);
+		unbind(&state().boundRenderbuffer, 1, n, renderbuffers);
+	}
+
+	static void APIENTRY bindRenderbuffer(GLenum target, GLuint renderbuffer)
+	{
+		state().bindRenderbuffer(target, renderbuffer);
+		state().boundRenderbuffer = (GLint)renderbuffer;
+	}
+
+	static void APIENTRY renderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height)
+	{
+		state().renderbufferStorage(target, internalformat, width, height);
+		Allocation* renderbuffer = bound(state().renderbuffers, &state().boundRenderbuffer, GL_RENDERBUFFER_BINDING,
+			RENDER_TARGETS);
+		if (renderbuffer)
+			setBytes(*renderbuffer, (size_t)width * height * texelBytes(internalformat));
+	}
+
+	static void APIENTRY renderbufferStorageMultisample(GLenum target, GLsizei samples, GLenum internalformat,
+		GLsizei width, GLsizei height)
+	{
+		state().renderbufferStorageMultisample(target, samples, internalformat, width, height);
+		Allocation* renderbuffer = bound(state().renderbuffers, &state().boundRenderbuffer, GL_RENDERBUFFER_BINDING,
+			RENDER_TARGETS);
+		if (renderbuffer)
+			setBytes(*renderbuffer, (size_t)width * height * (samples ? samples : 1) * texelBytes(internalformat));
+	}
+
+	static void APIENTRY genFramebuffers(GLsizei n, GLuint* framebuffers)
+	{
+		state().genFramebuffers(n, framebuffers);
+		for (GLsizei i = 0; i < n; i++)
+			state().framebuffers[framebuffers[i]] = owner();
+	}
+
+	static void APIENTRY deleteFramebuffers(GLsizei n, const GLuint* framebuffers)
+	{
+		state().deleteFramebuffers(n, framebuffers);
+		for (GLsizei i = 0; i < n; i++)
+			state().framebuffers.erase(framebuffers[i]);
+	}
+
+	// a texture drawn into is a render target
+	static void attached(GLuint name)
+	{
+		std::map<GLuint, Allocation>::iterator texture = state().textures.find(name);
+		if (texture != state().textures.end())
+			setCategory(texture->second, RENDER_TARGETS);
+	}
+
+	static void APIENTRY framebufferTexture(GLenum target, GLenum attachment, GLuint texture, GLint level)
+	{
+		state().framebufferTexture(target, attachment, texture, level);
+		attached(texture);
+	}
+
+	static void APIENTRY framebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture,
+		GLint level)
+	{
+		state().framebufferTexture2D(target, attachment, textarget, texture, level);
+		attached(texture);
+	}
+
+	static void APIENTRY framebufferTextureLayer(GLenum target, GLenum attachment, GLuint texture, GLint level,
+		GLint layer)
+	{
+		state().framebufferTextureLayer(target, attachment, texture, level, layer);
+		attached(texture);
+	}
+};
@@ -0,0 +1,257 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <string.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Where the GPU time of a frame goes, scope by scope.
+//
+// Every scope puts a GL_TIMESTAMP query at its start and at its end.
+// Timestamps nest, unlike GL_TIME_ELAPSED, and don't get in the way of the
+// GpuTimers. The queries come from a pool for each frame of a ring of
+// LATENCY frames and are only read when the frame comes round again, by
+// which time the GPU is (almost always) done with it. If it isn't, the new
+// frame goes unmeasured instead of waiting for the old one. Frames come
+// back in order.
+//
+// A scope is looked up by its name under its parent, and its path and
+// average are kept from the first frame it was in, so a frame builds no
+// strings once every scope has been seen. The names are kept, so they
+// are string literals.
+//
+//	profiler.beginFrame();
+//	{
+//		GpuProfiler::Scope scope(profiler, "tiles");
+//		...
+//	}
+//	profiler.endFrame();
+//	...
+//	profiler.getMilliseconds("frame/scene/tiles");
+//
+// Scopes outside beginFrame / endFrame are not measured.
+class GpuProfiler
+{
+public:
+	static const int LATENCY = 3;
+
+	struct Result
+	{
+		const char* path;		// the names from the frame down: "frame/scene/tiles"
+		const char* name;
+		int depth;				// 0 is the frame itself
+		double milliseconds;
+		double average;			// smoothed over the frames so far
+	};
+
+	class Scope
+	{
+	public:
+		Scope(GpuProfiler& profiler, const char* name)
+			: profiler(profiler)
+		{
+			profiler.push(name);
+		}
+
+		~Scope()
+		{
+			profiler.pop();
+		}
+
+	private:
+		GpuProfiler& profiler;
+	};
+
+	~GpuProfiler()
+	{
+		for (int i = 0; i < LATENCY; i++)
+			if (!this->frames[i].queries.empty())
+				glDeleteQueries((GLsizei)this->frames[i].queries.size(), this->frames[i].queries.data());
+	}
+
+	void beginFrame()
+	{
+		// pick up the frames that came back, oldest first
+		for (;;) {
+			Frame* oldest = nullptr;
+			for (int i = 0; i < LATENCY; i++)
+				if (this->frames[i].pending && (!oldest || this->frames[i].number < oldest->number))
+					oldest = &this->frames[i];
+			if (!oldest || !resolve(*oldest))
+				break;
+		}
+
+		Frame& frame = this->frames[this->frameNumber % LATENCY];
+		this->stack.clear();
+		this->active = !frame.pending;
+		if (this->active) {
+			frame.scopes.clear();
+			frame.used = 0;
+			frame.number = this->frameNumber + 1;
+		}
+		push("frame");
+	}
+
+	void endFrame()
+	{
+		pop();
+		if (this->active)
+			this->frames[this->frameNumber % LATENCY].pending = true;
+		this->active = false;
+		this->frameNumber++;
+	}
+
+	void push(const char* name)
+	{
+		if (!this->active)
+			return;
+		Frame& frame = this->frames[this->frameNumber % LATENCY];
+		TimedScope scope;
+		scope.node = node(this->stack.empty() ? -1 : frame.scopes[this->stack.back()].node, name);
+		scope.begin = query(frame);
+		scope.end = 0;
+		glQueryCounter(scope.begin, GL_TIMESTAMP);
+		this->stack.push_back((int)frame.scopes.size());
+		frame.scopes.push_back(scope);
+	}
+
+	void pop()
+	{
+		if (!this->active || this->stack.empty())
+			return;
+		Frame& frame = this->frames[this->frameNumber % LATENCY];
+		TimedScope& scope = frame.scopes[this->stack.back()];
+		scope.end = query(frame);
+		glQueryCounter(scope.end, GL_TIMESTAMP);
+		this->stack.pop_back();
+	}
+
+	// the scopes of the last frame that came back, in the order they began
+	const std::vector<Result>& getResults() const
+	{
+		return this->results;
+	}
+
+	// which frame getResults is (the first is 1), 0 while none came back
+	unsigned int getResultFrame() const
+	{
+		return this->resultFrame;
+	}
+
+	// the frames begun so far - the number the last one got
+	unsigned int getFrames() const
+	{
+		return this->frameNumber;
+	}
+
+	// one scope of getResults by its path, -1 if the frame didn't have it
+	double getMilliseconds(const char* path, bool average = false) const
+	{
+		for (const Result& result : this->results)
+			if (!strcmp(result.path, path))
+				return average ? result.average : result.milliseconds;
+		return -1.0;
+	}
+
+private:
+	struct TimedScope
+	{
+		int node;
+		GLuint begin;
+		GLuint end;
+	};
+
+	// a scope by where it is in the frame, whichever frames it was in
+	struct Node
+	{
+		const char* name;
+		int parent;
+		int depth;
+		std::string path;
+		double average;
+		bool measured;
+	};
+
+	struct Frame
+	{
+		std::vector<GLuint> queries;	// the pool of the frame, only grows
+		size_t used = 0;
+		std::vector<TimedScope> scopes;
+		unsigned int number = 0;
+		bool pending = false;
+	};
+
+	GLuint query(Frame& frame)
+	{
+		if (frame.used == frame.queries.size()) {
+			size_t more = frame.queries.empty() ? 32 : frame.queries.size();
+			frame.queries.resize(frame.used + more);
+			glGenQueries((GLsizei)more, &frame.queries[frame.used]);
+		}
+		return frame.queries[frame.used++];
+	}
+
+	// the node of a scope, made the first time it turns up
+	int node(int parent, const char* name)
+	{
+		for (size_t i = 0; i < this->nodes.size(); i++) {
+			const Node& node = this->nodes[i];
+			if (node.parent == parent && (node.name == name || !strcmp(node.name, name)))
+				return (int)i;
+		}
+		Node node;
+		node.name = name;
+		node.parent = parent;
+		node.depth = parent < 0 ? 0 : this->nodes[parent].depth + 1;
+		node.path = parent < 0 ? name : this->nodes[parent].path + "/" + name;
+		node.average = 0.0;
+		node.measured = false;
+		this->nodes.push_back(node);
+		return (int)this->nodes.size() - 1;
+	}
+
+	// read a frame back if the GPU is through with it
+	bool resolve(Frame& frame)
+	{
+		// the frame scope ends last, once it is there all of them are
+		GLint available = 0;
+		glGetQueryObjectiv(frame.scopes[0].end, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return false;
+
+		this->results.resize(frame.scopes.size());
+		for (size_t i = 0; i < frame.scopes.size(); i++) {
+			const TimedScope& scope = frame.scopes[i];
+			Result& result = this->results[i];
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(scope.begin, GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(scope.end, GL_QUERY_RESULT, &end);
+
+			Node& node = this->nodes[scope.node];
+			result.name = node.name;
+			result.depth = node.depth;
+			result.path = node.path.c_str();
+			result.milliseconds = (end - begin) / 1e6;
+
+			if (node.measured)
+				node.average += 0.1 * (result.milliseconds - node.average);
+			else
+				node.average = result.milliseconds;
+			node.measured = true;
+			result.average = node.average;
+		}
+		this->resultFrame = frame.number;
+		frame.pending = false;
+		return true;
+	}
+
+	Frame frames[LATENCY];
+	unsigned int frameNumber = 0;
+	bool active = false;
+	std::vector<int> stack;		// the open scopes of the frame
+
+	std::vector<Result> results;
+	unsigned int resultFrame = 0;
+	std::deque<Node> nodes;		// a deque keeps the paths of getResults where they are
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include <glad/glad.h>
+
+// Measures how long the GPU spends on a block of GL calls with
+// GL_TIME_ELAPSED queries.
+//
+// A query result is only ready once the GPU has actually run the commands,
+// so reading it straight away would stall the CPU until the frame is done.
+// Instead the timer keeps a ring of LATENCY queries and picks a result up a
+// few frames later, when it is (almost always) already there. If the query
+// that would be reused still isn't finished, that frame is simply not
+// measured.
+//
+// GL_TIME_ELAPSED queries can't be nested, so only one timer may be between
+// begin() and end() at a time.
+class GpuTimer
+{
+public:
+	static const int LATENCY = 4;
+
+	~GpuTimer()
+	{
+		if (this->created)
+			glDeleteQueries(LATENCY, this->queries);
+	}
+
+	void begin()
+	{
+		if (!this->created)
+		{
+			glGenQueries(LATENCY, this->queries);
+			this->created = true;
+		}
+
+		int index = this->frame % LATENCY;
+		this->active = !this->pending[index] || collect(index);
+		if (this->active)
+			glBeginQuery(GL_TIME_ELAPSED, this->queries[index]);
+	}
+
+	void end()
+	{
+		if (this->active)
+		{
+			glEndQuery(GL_TIME_ELAPSED);
+			this->pending[this->frame % LATENCY] = true;
+		}
+		this->active = false;
+		this->frame++;
+	}
+
+	// pick up every finished query without waiting. returns true if a new
+	// measurement arrived since the last call
+	bool poll()
+	{
+		bool updated = false;
+		for (int i = 1; i <= LATENCY; i++)
+		{
+			// oldest first
+			int index = (this->frame + i) % LATENCY;
+			if (this->pending[index] && collect(index))
+				updated = true;
+		}
+		return updated;
+	}
+
+	// the latest measurement, in milliseconds
+	double getMilliseconds() const
+	{
+		return this->milliseconds;
+	}
+
+private:
+	bool collect(int index)
+	{
+		GLint available = 0;
+		glGetQueryObjectiv(this->queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return false;
+
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(this->queries[index], GL_QUERY_RESULT, &nanoseconds);
+		this->milliseconds = nanoseconds / 1000000.0;
+		this->pending[index] = false;
+		return true;
+	}
+
+	GLuint queries[LATENCY];
+	bool pending[LATENCY] = {};
+	bool created = false;
+	bool active = false;
+	unsigned int frame = 0;
+	double milliseconds = 0.0;
+};
@@ -0,0 +1,303 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <vector>
+
+#include "Shader.h"
+
+// A heads up display: text, boxes and graphs in window pixels, drawn over
+// the frame.
+//
+// Everything between begin and end goes into one vertex buffer, which end
+// uploads and draws with a single draw call. The text is a 5x7 bitmap font
+// (upper case - lower case letters are drawn as upper case) in a small
+// texture, boxes and graphs sample a solid texel of it, so it is one
+// texture and one shader (hudVS / hudFS) for all of it.
+//
+//	hud.begin(w, h);
+//	hud.rect(x, y, 200, 100, 0x00000080);
+//	hud.print(x, y, 0xffffffff, "%.2f MS", ms);
+//	hud.graph(x, y, 200, 40, times, count, newest, 33.3f, 0x40ff40ff);
+//	hud.end();
+//
+// Colors are 0xRRGGBBAA, y goes down from the top of the window.
+class Hud
+{
+public:
+	static const int GLYPH_WIDTH = 5;
+	static const int GLYPH_HEIGHT = 7;
+	static const int CELL = 8;					// a glyph and its solid texel in the texture
+	static const int FIRST_GLYPH = 32;			// ' '
+	static const int GLYPH_COUNT = 64;			// ' ' to '_'
+
+	// font pixels to window pixels
+	float scale = 2.0f;
+
+	// takes the hudVS / hudFS shader
+	Hud(Shader* shader)
+		: shader(shader)
+	{
+		// the glyphs in a row, and a solid cell after them
+		int width = (GLYPH_COUNT + 1) * CELL;
+		std::vector<unsigned char> texels(width * CELL, 0);
+		for (int glyph = 0; glyph < GLYPH_COUNT; glyph++)
+			for (int y = 0; y < GLYPH_HEIGHT; y++)
+				for (int x = 0; x < GLYPH_WIDTH; x++)
+					if (font()[glyph][y] & (0x10 >> x))
+						texels[y * width + glyph * CELL + x] = 255;
+		for (int y = 0; y < CELL; y++)
+			for (int x = 0; x < CELL; x++)
+				texels[y * width + GLYPH_COUNT * CELL + x] = 255;
+
+		glGenTextures(1, &this->texture);
+		glBindTexture(GL_TEXTURE_2D, this->texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, CELL, 0, GL_RED, GL_UNSIGNED_BYTE, texels.data());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		// white, with the font as its alpha
+		GLint swizzle[] = { GL_ONE, GL_ONE, GL_ONE, GL_RED };
+		glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		this->textureWidth = (float)width;
+
+		glGenVertexArrays(1, &this->vao);
+		glGenBuffers(1, &this->vbo);
+		glBindVertexArray(this->vao);
+		glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(2 * sizeof(GLfloat)));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (GLvoid*)(4 * sizeof(GLfloat)));
+		glEnableVertexAttribArray(2);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		// the font is always unit 0, only the size changes
+		this->shader->Use();
+		this->sizeLocation = glGetUniformLocation(this->shader->Program, "u_size");
+		glUniform1i(glGetUniformLocation(this->shader->Program, "u_font"), 0);
+		glUseProgram(0);
+	}
+
+	~Hud()
+	{
+		glDeleteTextures(1, &this->texture);
+		glDeleteBuffers(1, &this->vbo);
+		glDeleteVertexArrays(1, &this->vao);
+		delete this->shader;
+	}
+
+	// the size of the window
+	void begin(int w, int h)
+	{
+		this->width = w;
+		this->height = h;
+		this->vertices.clear();
+	}
+
+	// window pixels a line of text takes
+	float lineHeight() const
+	{
+		return (GLYPH_HEIGHT + 2) * this->scale;
+	}
+
+	float charWidth() const
+	{
+		return (GLYPH_WIDTH + 1) * this->scale;
+	}
+
+	void rect(float x, float y, float w, float h, unsigned int color)
+	{
+		float u = (GLYPH_COUNT * CELL + CELL / 2) / this->textureWidth;
+		float v = 0.5f;
+		quad(x, y, x + w, y + h, u, v, u, v, color);
+	}
+
+	// returns where the text ends
+	float text(float x, float y, const char* text, unsigned int color)
+	{
+		for (const char* c = text; *c; c++) {
+			int code = *c >= 'a' && *c <= 'z' ? *c - 'a' + 'A' : *c;
+			int glyph = code - FIRST_GLYPH;
+			if (glyph < 0 || glyph >= GLYPH_COUNT)
+				glyph = '?' - FIRST_GLYPH;
+			if (glyph) {
+				float u0 = glyph * CELL / this->textureWidth;
+				float u1 = (glyph * CELL + GLYPH_WIDTH) / this->textureWidth;
+				float v1 = GLYPH_HEIGHT / (float)CELL;
+				quad(x, y, x + GLYPH_WIDTH * this->scale, y + GLYPH_HEIGHT * this->scale, u0, 0.0f, u1, v1, color);
+			}
+			x += charWidth();
+		}
+		return x;
+	}
+
+	float print(float x, float y, unsigned int color, const char* format, ...)
+	{
+		char line[256];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(line, sizeof(line), format, args);
+		va_end(args);
+		return text(x, y, line, color);
+	}
+
+	// a bar for each of count values of a ring, oldest on the left, newest
+	// at index newest. values above max are clipped
+	void graph(float x, float y, float w, float h, const float* values, int count, int newest, float max,
+		unsigned int color)
+	{
+		float bar = w / count;
+		for (int i = 0; i < count; i++) {
+			float value = values[(newest + 1 + i) % count];
+			float top = h * (value < max ? value / max : 1.0f);
+			if (top > 0.0f)
+				rect(x + i * bar, y + h - top, bar, top, color);
+		}
+	}
+
+	// upload all of it and draw it, over whatever framebuffer is bound.
+	// the state is set, not asked for: afterwards the depth test is on and
+	// blending is on with the usual alpha blend, like the frame draws with
+	void end()
+	{
+		if (this->vertices.empty())
+			return;
+
+		glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+		// a new buffer every frame - the driver doesn't have to wait for
+		// the last one to be drawn
+		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), this->vertices.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		glDisable(GL_DEPTH_TEST);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glViewport(0, 0, this->width, this->height);
+
+		this->shader->Use();
+		glUniform2f(this->sizeLocation, (float)this->width, (float)this->height);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, this->texture);
+		glBindVertexArray(this->vao);
+		glDrawArrays(GL_TRIANGLES, 0, (GLsizei)this->vertices.size());
+		glBindVertexArray(0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glUseProgram(0);
+
+		glEnable(GL_DEPTH_TEST);
+	}
+
+private:
+	struct Vertex
+	{
+		GLfloat x, y;
+		GLfloat u, v;
+		GLubyte color[4];
+	};
+
+	void quad(float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1, unsigned int color)
+	{
+		Vertex corners[4] = {
+			{ x0, y0, u0, v0 }, { x1, y0, u1, v0 }, { x1, y1, u1, v1 }, { x0, y1, u0, v1 }
+		};
+		for (Vertex& corner : corners) {
+			corner.color[0] = (GLubyte)(color >> 24);
+			corner.color[1] = (GLubyte)(color >> 16);
+			corner.color[2] = (GLubyte)(color >> 8);
+			corner.color[3] = (GLubyte)color;
+		}
+		const int order[6] = { 0, 1, 2, 2, 3, 0 };
+		for (int i : order)
+			this->vertices.push_back(corners[i]);
+	}
+
+	// 5x7, a row per byte, the leftmost pixel in bit 4
+	static const unsigned char (*font())[GLYPH_HEIGHT]
+	{
+		static const unsigned char glyphs[GLYPH_COUNT][GLYPH_HEIGHT] = {
+			{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// ' '
+			{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 },	// '!'
+			{ 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00 },	// '"'
+			{ 0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a },	// '#'
+			{ 0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04 },	// '$'
+			{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },	// '%'
+			{ 0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d },	// '&'
+			{ 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 },	// '''
+			{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },	// '('
+			{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },	// ')'
+			{ 0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00 },	// '*'
+			{ 0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00 },	// '+'
+			{ 0x00, 0x00, 0x00, 0x00, 0x06, 0x04, 0x08 },	// ','
+			{ 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00 },	// '-'
+			{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c },	// '.'
+			{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },	// '/'
+			{ 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e },	// '0'
+			{ 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e },	// '1'
+			{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f },	// '2'
+			{ 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e },	// '3'
+			{ 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02 },	// '4'
+			{ 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e },	// '5'
+			{ 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e },	// '6'
+			{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },	// '7'
+			{ 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e },	// '8'
+			{ 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c },	// '9'
+			{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00 },	// ':'
+			{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08 },	// ';'
+			{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 },	// '<'
+			{ 0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00 },	// '='
+			{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 },	// '>'
+			{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 },	// '?'
+			{ 0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e },	// '@'
+			{ 0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 },	// 'A'
+			{ 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e },	// 'B'
+			{ 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e },	// 'C'
+			{ 0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c },	// 'D'
+			{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f },	// 'E'
+			{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10 },	// 'F'
+			{ 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f },	// 'G'
+			{ 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 },	// 'H'
+			{ 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e },	// 'I'
+			{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c },	// 'J'
+			{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },	// 'K'
+			{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f },	// 'L'
+			{ 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11 },	// 'M'
+			{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },	// 'N'
+			{ 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e },	// 'O'
+			{ 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10 },	// 'P'
+			{ 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d },	// 'Q'
+			{ 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11 },	// 'R'
+			{ 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e },	// 'S'
+			{ 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },	// 'T'
+			{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e },	// 'U'
+			{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04 },	// 'V'
+			{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a },	// 'W'
+			{ 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11 },	// 'X'
+			{ 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04 },	// 'Y'
+			{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f },	// 'Z'
+			{ 0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e },	// '['
+			{ 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 },	// backslash
+			{ 0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e },	// ']'
+			{ 0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00 },	// '^'
+			{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f },	// '_'
+		};
+		return glyphs;
+	}
+
+	Shader* shader;
+	GLint sizeLocation = -1;
+	GLuint texture = 0;
+	float textureWidth = 1.0f;
+	GLuint vao = 0;
+	GLuint vbo = 0;
+	std::vector<Vertex> vertices;
+	int width = 0;
+	int height = 0;
+};
@@ -0,0 +1,264 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <vector>
+
+#include "Shader.h"
+
+// Retained, instanced drawing of the small marker meshes of the scene: the
+// control point "arrow" and the debug sphere.
+//
+// Both meshes live in one static vertex / index buffer. Every mesh has its
+// own buffer of instances (a model matrix and a color each) that is only
+// uploaded by setInstances, so when nothing moved a frame draws all the
+// instances of a mesh in one call without sending anything.
+//
+//	markers.setInstances(InstancedMarkers::CONTROL_POINT, instances);	// on change
+//	markers.draw(InstancedMarkers::CONTROL_POINT, projection * view);
+//
+// drawIds draws the same instances as ids, for the PickBuffer.
+class InstancedMarkers
+{
+public:
+	enum Mesh
+	{
+		CONTROL_POINT,
+		SPHERE,
+		MESH_COUNT
+	};
+
+	struct Instance
+	{
+		glm::mat4 model;
+		glm::vec4 color;
+	};
+
+	// takes the markerVS / markerFS shader and the markerVS / markerIdFS
+	// one
+	InstancedMarkers(Shader* shader, Shader* idShader)
+		: shader(shader), idShader(idShader)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<GLuint> elements;
+		addControlPoint(vertices, elements);
+		addSphere(vertices, elements, 100, 20);
+
+		glGenBuffers(1, &this->vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+		glGenBuffers(1, &this->ebo);
+		glGenBuffers(MESH_COUNT, this->instanceBuffers);
+		glGenVertexArrays(MESH_COUNT, this->vaos);
+
+		// one VAO per mesh: the shared mesh buffers, its own instances
+		for (int i = 0; i < MESH_COUNT; i++)
+		{
+			glBindVertexArray(this->vaos[i]);
+
+			glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(3 * sizeof(GLfloat)));
+			glEnableVertexAttribArray(1);
+
+			// model matrix in 2 - 5 (a column each), color in 6
+			glBindBuffer(GL_ARRAY_BUFFER, this->instanceBuffers[i]);
+			for (int column = 0; column < 4; column++)
+			{
+				glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+					(GLvoid*)(column * sizeof(glm::vec4)));
+				glEnableVertexAttribArray(2 + column);
+				glVertexAttribDivisor(2 + column, 1);
+			}
+			glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (GLvoid*)sizeof(glm::mat4));
+			glEnableVertexAttribArray(6);
+			glVertexAttribDivisor(6, 1);
+
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ebo);
+			if (i == 0)
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements.size() * sizeof(GLuint), elements.data(), GL_STATIC_DRAW);
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	~InstancedMarkers()
+	{
+		glDeleteVertexArrays(MESH_COUNT, this->vaos);
+		glDeleteBuffers(MESH_COUNT, this->instanceBuffers);
+		glDeleteBuffers(1, &this->vbo);
+		glDeleteBuffers(1, &this->ebo);
+		delete this->shader;
+		delete this->idShader;
+	}
+
+	// replace the instances of a mesh. the buffer only grows, a smaller
+	// list is written over the start of it
+	void setInstances(Mesh mesh, const std::vector<Instance>& instances)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, this->instanceBuffers[mesh]);
+		if (instances.size() > this->capacity[mesh])
+		{
+			this->capacity[mesh] = instances.size();
+			glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.data(), GL_DYNAMIC_DRAW);
+		}
+		else if (!instances.empty())
+			glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(Instance), instances.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		this->instanceCount[mesh] = (GLsizei)instances.size();
+	}
+
+	// every instance of the mesh in one draw. shadow draws them flat in
+	// transparent black (the "squish onto the floor" has to be in
+	// view_projection already)
+	void draw(Mesh mesh, const glm::mat4& view_projection, bool shadow = false)
+	{
+		if (!this->instanceCount[mesh])
+			return;
+
+		this->shader->Use();
+		glUniformMatrix4fv(glGetUniformLocation(this->shader->Program, "u_view_projection"),
+			1, GL_FALSE, &view_projection[0][0]);
+		glUniform1i(glGetUniformLocation(this->shader->Program, "u_shadow"), shadow);
+
+		drawInstances(mesh);
+		glUseProgram(0);
+	}
+
+	// every instance of the mesh as its id: firstId + the instance index
+	void drawIds(Mesh mesh, const glm::mat4& view_projection, GLuint firstId)
+	{
+		if (!this->instanceCount[mesh])
+			return;
+
+		this->idShader->Use();
+		glUniformMatrix4fv(glGetUniformLocation(this->idShader->Program, "u_view_projection"),
+			1, GL_FALSE, &view_projection[0][0]);
+		glUniform1ui(glGetUniformLocation(this->idShader->Program, "u_first_id"), firstId);
+
+		drawInstances(mesh);
+		glUseProgram(0);
+	}
+
+private:
+	struct Vertex
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+	};
+
+	// where a mesh is in the shared buffers
+	struct Range
+	{
+		GLsizei count;
+		GLuint firstElement;
+		GLint baseVertex;
+	};
+
+	void drawInstances(Mesh mesh)
+	{
+		glBindVertexArray(this->vaos[mesh]);
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, this->ranges[mesh].count, GL_UNSIGNED_INT,
+			(GLvoid*)(this->ranges[mesh].firstElement * sizeof(GLuint)),
+			this->instanceCount[mesh], this->ranges[mesh].baseVertex);
+		glBindVertexArray(0);
+	}
+
+	void begin(Mesh mesh, const std::vector<Vertex>& vertices, const std::vector<GLuint>& elements)
+	{
+		this->ranges[mesh].firstElement = (GLuint)elements.size();
+		this->ranges[mesh].baseVertex = (GLint)vertices.size();
+	}
+
+	void end(Mesh mesh, const std::vector<GLuint>& elements)
+	{
+		this->ranges[mesh].count = (GLsizei)(elements.size() - this->ranges[mesh].firstElement);
+	}
+
+	// the shape ControlPoint::draw makes: an open topped box with a
+	// pyramid on it, pointing up the y axis
+	void addControlPoint(std::vector<Vertex>& vertices, std::vector<GLuint>& elements)
+	{
+		begin(CONTROL_POINT, vertices, elements);
+		const float size = 2.0f;
+		const GLuint first = (GLuint)vertices.size();
+
+		// the sides and the bottom, a quad each (no top - it is the point)
+		const glm::vec3 quads[5][5] = {
+			// normal, then the corners
+			{ { 0, 0, 1 },  { size, size, size },  { -size, size, size },  { -size, -size, size },  { size, -size, size } },
+			{ { 0, 0, -1 }, { size, size, -size }, { size, -size, -size }, { -size, -size, -size }, { -size, size, -size } },
+			{ { 0, -1, 0 }, { size, -size, size }, { -size, -size, size }, { -size, -size, -size }, { size, -size, -size } },
+			{ { 1, 0, 0 },  { size, size, size },  { size, -size, size },  { size, -size, -size },  { size, size, -size } },
+			{ { -1, 0, 0 }, { -size, size, size }, { -size, size, -size }, { -size, -size, -size }, { -size, -size, size } },
+		};
+		for (int q = 0; q < 5; q++)
+		{
+			GLuint base = (GLuint)vertices.size() - first;
+			for (int c = 1; c <= 4; c++)
+				vertices.push_back({ quads[q][c], quads[q][0] });
+			GLuint quad[6] = { 0, 1, 2, 2, 3, 0 };
+			for (int e = 0; e < 6; e++)
+				elements.push_back(base + quad[e]);
+		}
+
+		// the point, a fan around the tip
+		GLuint tip = (GLuint)vertices.size() - first;
+		vertices.push_back({ glm::vec3(0.0f, 3.0f * size, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f) });
+		const glm::vec2 corners[4] = { { 1, 1 }, { -1, 1 }, { -1, -1 }, { 1, -1 } };
+		for (int c = 0; c < 4; c++)
+			vertices.push_back({ glm::vec3(corners[c].x * size, size, corners[c].y * size),
+				glm::normalize(glm::vec3(corners[c].x, 0.0f, corners[c].y)) });
+		for (int c = 0; c < 4; c++)
+		{
+			elements.push_back(tip);
+			elements.push_back(tip + 1 + c);
+			elements.push_back(tip + 1 + (c + 1) % 4);
+		}
+		end(CONTROL_POINT, elements);
+	}
+
+	// unit sphere around the z axis, like gluSphere
+	void addSphere(std::vector<Vertex>& vertices, std::vector<GLuint>& elements, int slices, int stacks)
+	{
+		begin(SPHERE, vertices, elements);
+		const float PI = 3.14159265f;
+		for (int stack = 0; stack <= stacks; stack++)
+		{
+			float phi = PI * stack / stacks;
+			for (int slice = 0; slice <= slices; slice++)
+			{
+				float theta = 2.0f * PI * slice / slices;
+				glm::vec3 p(std::sin(phi) * std::cos(theta), std::sin(phi) * std::sin(theta), std::cos(phi));
+				vertices.push_back({ p, p });
+			}
+		}
+		for (int stack = 0; stack < stacks; stack++)
+		{
+			for (int slice = 0; slice < slices; slice++)
+			{
+				GLuint a = stack * (slices + 1) + slice;
+				GLuint b = a + slices + 1;
+				elements.push_back(a);
+				elements.push_back(b);
+				elements.push_back(a + 1);
+				elements.push_back(a + 1);
+				elements.push_back(b);
+				elements.push_back(b + 1);
+			}
+		}
+		end(SPHERE, elements);
+	}
+
+	Shader* shader;
+	Shader* idShader;
+	GLuint vbo = 0;
+	GLuint ebo = 0;
+	GLuint vaos[MESH_COUNT];
+	GLuint instanceBuffers[MESH_COUNT];
+	size_t capacity[MESH_COUNT] = {};
+	GLsizei instanceCount[MESH_COUNT] = {};
+	Range ranges[MESH_COUNT];
+};
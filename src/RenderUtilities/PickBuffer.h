@@ -0,0 +1,155 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Picking with an ID buffer, instead of GL_SELECT.
+//
+// The pickable objects draw an id (0 is nothing) into a small R32UI target
+// through a projection narrowed down to the few pixels around the cursor,
+// with a depth buffer, so the nearest object wins. The pixel under the
+// cursor is copied into a pixel buffer and read a bit later, once a fence
+// says the GPU got there - picking never waits for the whole pipeline.
+//
+//	glm::mat4 region = pick.begin(x, y, width, height);
+//	...draw the ids with region * projection * view...
+//	pick.end();
+//	...
+//	GLuint id;
+//	if (pick.result(id, false)) ...		// or true to wait for it
+class PickBuffer
+{
+public:
+	// window pixels drawn around the cursor (odd, so there is a center)
+	static const int SIZE = 5;
+
+	PickBuffer()
+	{
+		glGenTextures(1, &this->idTexture);
+		glBindTexture(GL_TEXTURE_2D, this->idTexture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, SIZE, SIZE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenRenderbuffers(1, &this->depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, this->depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, SIZE, SIZE);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		GLint framebuffer;
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+		glGenFramebuffers(1, &this->frameBuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->frameBuffer);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, this->idTexture, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depthBuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+		glGenBuffers(1, &this->pixelBuffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, this->pixelBuffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(GLuint), NULL, GL_STREAM_READ);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	~PickBuffer()
+	{
+		if (this->fence)
+			glDeleteSync(this->fence);
+		glDeleteBuffers(1, &this->pixelBuffer);
+		glDeleteFramebuffers(1, &this->frameBuffer);
+		glDeleteRenderbuffers(1, &this->depthBuffer);
+		glDeleteTextures(1, &this->idTexture);
+	}
+
+	// draw into the pick target from now on. (x, y) is the window pixel
+	// under the cursor, from the bottom left. returns the matrix that goes
+	// in front of the projection (like gluPickMatrix)
+	glm::mat4 begin(int x, int y, int width, int height)
+	{
+		glGetIntegerv(GL_VIEWPORT, this->savedViewport);
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &this->savedDrawFramebuffer);
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &this->savedReadFramebuffer);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, this->frameBuffer);
+		glViewport(0, 0, SIZE, SIZE);
+		const GLuint nothing[4] = { 0, 0, 0, 0 };
+		glClearBufferuiv(GL_COLOR, 0, nothing);
+		glDepthMask(GL_TRUE);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		glEnable(GL_DEPTH_TEST);
+
+		// blow the SIZE x SIZE pixels around the cursor up to the whole
+		// viewport - the center of the cursor pixel lands on 0, 0
+		glm::mat4 region;
+		region[0][0] = (float)width / SIZE;
+		region[1][1] = (float)height / SIZE;
+		region[3][0] = (width - 2.0f * (x + 0.5f)) / SIZE;
+		region[3][1] = (height - 2.0f * (y + 0.5f)) / SIZE;
+		return region;
+	}
+
+	// start reading the id under the cursor back, and go back to the
+	// framebuffer that was bound before begin
+	void end()
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, this->pixelBuffer);
+		glReadPixels(SIZE / 2, SIZE / 2, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		// a newer pick replaces one that hasn't been picked up
+		if (this->fence)
+			glDeleteSync(this->fence);
+		this->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		// make sure the fence gets to the GPU, or waiting on it never ends
+		glFlush();
+
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->savedDrawFramebuffer);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, this->savedReadFramebuffer);
+		glViewport(this->savedViewport[0], this->savedViewport[1], this->savedViewport[2], this->savedViewport[3]);
+	}
+
+	// is a pick on its way?
+	bool pending() const
+	{
+		return this->fence != 0;
+	}
+
+	// the id of the last pick, once. false while it hasn't arrived yet (or
+	// there is no pick) - wait blocks until it has
+	bool result(GLuint& id, bool wait)
+	{
+		if (!this->fence)
+			return false;
+
+		GLenum status = glClientWaitSync(this->fence, 0, wait ? WAIT_NANOSECONDS : 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+			return false;
+		glDeleteSync(this->fence);
+		this->fence = 0;
+
+		id = 0;
+		if (status == GL_WAIT_FAILED)
+			return true;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, this->pixelBuffer);
+		GLuint* pixel = (GLuint*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(GLuint), GL_MAP_READ_BIT);
+		if (pixel)
+		{
+			id = *pixel;
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		return true;
+	}
+
+private:
+	static const GLuint64 WAIT_NANOSECONDS = 1000000000;	// a second
+
+	GLuint frameBuffer = 0;
+	GLuint idTexture = 0;
+	GLuint depthBuffer = 0;
+	GLuint pixelBuffer = 0;
+	GLsync fence = 0;
+
+	GLint savedViewport[4];
+	GLint savedDrawFramebuffer = 0;
+	GLint savedReadFramebuffer = 0;
+};
@@ -3,6 +3,8 @@
 
 #include <glad/glad.h>
 
+#include "CpuProfiler.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -22,6 +24,7 @@ public:
 		TESS_EVALUATION_SHADER = (1 << 2),
 		GEOMETRY_SHADER = (1 << 3),
 		FRAGMENT_SHADER = (1 << 4),
+		COMPUTE_SHADER = (1 << 5),
 	};
 	//DEFINE_ENUM_FLAG_OPERATORS(Type);
 
@@ -29,6 +32,7 @@ public:
 	// Constructor generates the shader on the fly
 	Shader(const GLchar* vert, const GLchar* tesc, const GLchar* tese, const char* geom, const char* frag)
 	{
+		PROFILE_ZONE("Shader");
 		std::vector<GLuint> shaders;
 		if (vert)
 		{
@@ -55,6 +59,24 @@ public:
 			shaders.push_back(this->compileShader(GL_FRAGMENT_SHADER, this->readCode(frag).c_str()));
 			this->type = (Shader::Type)(this->type | Type::FRAGMENT_SHADER);
 		}
+		this->link(shaders);
+	}
+	// Compute shader - a program of its own
+	explicit Shader(const GLchar* comp)
+	{
+		std::vector<GLuint> shaders;
+		shaders.push_back(this->compileShader(GL_COMPUTE_SHADER, this->readCode(comp).c_str()));
+		this->type = Type::COMPUTE_SHADER;
+		this->link(shaders);
+	}
+	// Uses the current shader
+	void Use()
+	{
+		glUseProgram(this->Program);
+	}
+private:
+	void link(const std::vector<GLuint>& shaders)
+	{
 		// Shader Program
 		GLint success;
 		GLchar infoLog[512];
@@ -75,12 +97,6 @@ public:
 		for (GLuint shader : shaders)
 			glDeleteShader(shader);
 	}
-	// Uses the current shader
-	void Use()
-	{
-		glUseProgram(this->Program);
-	}
-private:
 	std::string readCode(const GLchar* path)
 	{
 		std::string code;
@@ -105,10 +121,42 @@ private:
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 			std::cout << path << std::endl;
 		}
-		return code;
+		return this->includeCode(path, code);
+	}
+	// #include "file" lines get the file, from the directory of the shader -
+	// the water shaders share their shading that way. a #line after it
+	// keeps the line numbers of the errors in the rest of the shader
+	std::string includeCode(const GLchar* path, const std::string& code)
+	{
+		if (code.find("#include") == std::string::npos)
+			return code;
+		std::string directory(path);
+		size_t slash = directory.find_last_of("/\\");
+		directory = slash == std::string::npos ? "" : directory.substr(0, slash + 1);
+
+		std::string result;
+		std::istringstream lines(code);
+		std::string line;
+		int number = 0;
+		while (std::getline(lines, line))
+		{
+			number++;
+			size_t open = line.find('"');
+			size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+			if (line.compare(0, 8, "#include") || close == std::string::npos)
+			{
+				result += line + "\n";
+				continue;
+			}
+			std::string file = directory + line.substr(open + 1, close - open - 1);
+			result += this->readCode(file.c_str());
+			result += "\n#line " + std::to_string(number + 1) + "\n";
+		}
+		return result;
 	}
 	GLuint compileShader(GLenum shader_type, const char* code)
 	{
+		PROFILE_ZONE("Shader::compileShader");
 		GLuint shader_number;
 		GLint success;
 		GLchar infoLog[512];
@@ -131,6 +179,8 @@ private:
 				std::cout << "ERROR::SHADER::GEOMETRY::COMPILATION_FAILED\n" << infoLog << std::endl;
 			else if (shader_type == GL_FRAGMENT_SHADER)
 				std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+			else if (shader_type == GL_COMPUTE_SHADER)
+				std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
 		}
 		return shader_number;
 	}
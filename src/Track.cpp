@@ -26,7 +26,9 @@
 
 #include "Track.H"
 
-#include <FL/fl_ask.h>
+#include <FL/fl_ask.H>
+
+#include "RenderUtilities/CpuProfiler.h"
 
 //****************************************************************************
 //
@@ -109,6 +111,7 @@ void CTrack::
 readPoints(const char* filename)
 //============================================================================
 {
+	PROFILE_ZONE("CTrack::readPoints");
 	FILE* fp = fopen(filename,"r");
 	if (!fp) {
 		fl_alert("Can't Open File!\n");
@@ -26,10 +26,16 @@
 
 // TODO: move camera position and mix it.
 #include <iostream>
-#include <Fl/fl.h>
+#include <future>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+#include <FL/Fl.H>
 
 // we will need OpenGL, and OpenGL needs windows.h
+#ifdef _WIN32
 #include <windows.h>
+#endif
 //#include "GL/gl.h"
 #include <glad/glad.h>
 #include <glm/glm.hpp>
@@ -38,7 +44,7 @@
 
 #include "TrainView.H"
 #include "TrainWindow.H"
-#include "Utilities/3DUtils.H"
+#include "Utilities/3DUtils.h"
 
 #ifdef EXAMPLE_SOLUTION
 #	include "TrainExample/TrainExample.H"
@@ -48,44 +54,6 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-
-glm::vec3 ExtractCameraPos(const glm::mat4& a_modelView)
-{
-	// Get the 3 basis vector planes at the camera origin and transform them into model space.
-	//  
-	// NOTE: Planes have to be transformed by the inverse transpose of a matrix
-	//       Nice reference here: http://www.opengl.org/discussion_boards/showthread.php/159564-Clever-way-to-transform-plane-by-matrix
-	//
-	//       So for a transform to model space we need to do:
-	//            inverse(transpose(inverse(MV)))
-	//       This equals : transpose(MV) - see Lemma 5 in http://mathrefresher.blogspot.com.au/2007/06/transpose-of-matrix.html
-	//
-	// As each plane is simply (1,0,0,0), (0,1,0,0), (0,0,1,0) we can pull the data directly from the transpose matrix.
-	//  
-	glm::mat4 modelViewT = glm::transpose(a_modelView);
-
-	// Get plane normals 
-	glm::vec3 n1(modelViewT[0]);
-	glm::vec3 n2(modelViewT[1]);
-	glm::vec3 n3(modelViewT[2]);
-
-	// Get plane distances
-	float d1(modelViewT[0].w);
-	float d2(modelViewT[1].w);
-	float d3(modelViewT[2].w);
-
-	// Get the intersection of these 3 planes
-	// http://paulbourke.net/geometry/3planes/
-	glm::vec3 n2n3 = cross(n2, n3);
-	glm::vec3 n3n1 = cross(n3, n1);
-	glm::vec3 n1n2 = cross(n1, n2);
-
-	glm::vec3 top = (n2n3 * d1) + (n3n1 * d2) + (n1n2 * d3);
-	float denom = dot(n1, n2n3);
-
-	return top / -denom;
-}
-
 //************************************************************************
 //
 // * Constructor to set up the GL window
@@ -100,6 +68,25 @@ TrainView(int x, int y, int w, int h, const char* l)
 	resetArcball();
 }
 
+//************************************************************************
+//
+// * Read the widgets of the TrainWindow into settings - without a window
+//   (headless) they are set directly and stay as they are
+//========================================================================
+void TrainView::
+syncSettings()
+//========================================================================
+{
+	if (!tw)
+		return;
+	settings.worldCam = tw->worldCam->value() != 0;
+	settings.topCam = tw->topCam->value() != 0;
+	settings.trainCam = tw->trainCam->value() != 0;
+	settings.wave = tw->waveBrowser->value();
+	settings.amplitude = (float)tw->amplitude->value();
+	settings.waveLength = (float)tw->waveLength->value();
+}
+
 //************************************************************************
 //
 // * Reset the camera to look at the world
@@ -129,7 +116,16 @@ int TrainView::handle(int event)
 	// see if the ArcBall will handle the event - if it does, 
 	// then we're done
 	// note: the arcball only gets the event if we're in world view;
-	if (tw->worldCam->value())
+	syncSettings();
+
+	// while a replay runs it is the only input - the live mouse and
+	// keyboard are dropped. a recording writes down what comes in
+	if (inputReplay && !inputReplay->finished() && !inputReplay->playing() && InputRecorder::isInput(event))
+		return 1;
+	if (inputRecorder)
+		inputRecorder->event(*this, event);
+
+	if (settings.worldCam)
 	{
 		if (arcball.handle(event))
 		{
@@ -142,6 +138,11 @@ int TrainView::handle(int event)
 	// remember what button was used
 	static int last_push;
 
+	// everything below may look at the selection - pick up the last pick
+	// if it is still on its way
+	if (event == FL_DRAG || event == FL_RELEASE || event == FL_KEYBOARD)
+		resolvePick(true);
+
 	switch (event) {
 		// Mouse button being pushed event
 	case FL_PUSH:
@@ -213,6 +214,47 @@ int TrainView::handle(int event)
 
 			return 1;
 		};
+		if (k == 'r') {
+			reflectionMode = !reflectionMode;
+			printf("%s reflection\n", reflectionMode ? "Screen space" : "Planar");
+			damage(1);
+			return 1;
+		}
+		if (k == 'd') {
+			depthShading = !depthShading;
+			printf("Depth aware water %s\n", depthShading ? "on" : "off");
+			damage(1);
+			return 1;
+		}
+		if (k == 'z') {
+			waterDepthPrepass = !waterDepthPrepass;
+			printf("Water depth prepass %s\n", waterDepthPrepass ? "on" : "off");
+			damage(1);
+			return 1;
+		}
+		if (k == 'l') {
+			layeredPrepass = !layeredPrepass;
+			printf("Layered water prepass %s\n", layeredPrepass ? "on" : "off");
+			damage(1);
+			return 1;
+		}
+		if (k == 'h') {
+			showHud = !showHud;
+			damage(1);
+			return 1;
+		}
+		if (k == 'c') {
+			if (cameraPath) {
+				fclose(cameraPath);
+				cameraPath = nullptr;
+				printf("Camera path written to camera_path.txt\n");
+			}
+			else {
+				cameraPath = fopen("camera_path.txt", "w");
+				printf(cameraPath ? "Recording the camera path\n" : "Can't write camera_path.txt\n");
+			}
+			return 1;
+		}
 		break;
 	}
 
@@ -226,49 +268,83 @@ int TrainView::handle(int event)
 //========================================================================
 void TrainView::draw()
 {
+	PROFILE_ZONE("TrainView::draw");
+
+	// time between frames, for the overlay
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	if (hudLastFrame > 0.0) {
+		hudNewest = (hudNewest + 1) % HUD_HISTORY;
+		hudFrameTimes[hudNewest] = (float)((seconds - hudLastFrame) * 1000.0);
+	}
+	hudLastFrame = seconds;
+
 	t_time += 0.01f;
+	syncSettings();
+	// what was recorded up to this frame goes in first
+	if (inputReplay)
+		inputReplay->frame(*this);
+	if (inputRecorder)
+		inputRecorder->frame(*this);
+	resolvePick(false);
+	if (cameraPath)
+		arcball.writePose(cameraPath);
 	//*********************************************************************
 	//
 	// * Set up basic opengl informaiton
 	//
 	//**********************************************************************
-	//initialized glad
-	if (gladLoadGL())
+	//initialized glad (once - loading it queries the driver)
+	if (!this->glLoaded)
 	{
+		// (without a window the context isn't one glad knows how to
+		// load from, whoever made it hands over its loader)
+		if (!(this->glLoader ? gladLoadGLLoader(this->glLoader) : gladLoadGL()))
+			throw std::runtime_error("Could not initialize GLAD!");
+		this->glLoaded = true;
+		// count the draw calls (for the overlay) and what is allocated
+		DrawStats::install();
+		GpuMemory::install();
+
 		//initiailize VAO, VBO, Shader...
 		initTilesShader();
 		initSineWater();
 		initHeightWater();
 		initSkyboxShader();
+		initLayeredShaders();
 		initMonitor();
-		if (!this->fbos)
-			this->fbos = new WaterFrameBuffers();
+		initBounds();
+		initMarkers();
+		if (!this->depthPyramid)
+			this->depthPyramid = new DepthPyramid(new Shader(PROJECT_DIR "/src/shaders/depthPyramidCS.glsl"));
+		if (!this->fbos) {
+			GpuMemory::Owner owner("water targets");
+			this->fbos = new WaterFrameBuffers(pixel_w(), pixel_h());
+		}
+		initFrameGraph();
 
 		// forBzy
-		if (!this->commom_matrices)
+		// (the buffer goes with the UBO - made once, not every time glad is)
+		if (!this->commom_matrices) {
+			GpuMemory::Owner owner("matrices");
 			this->commom_matrices = new UBO();
-		this->commom_matrices->size = 2 * sizeof(glm::mat4);
-		glGenBuffers(1, &this->commom_matrices->ubo);
-		glBindBuffer(GL_UNIFORM_BUFFER, this->commom_matrices->ubo);
-		glBufferData(GL_UNIFORM_BUFFER, this->commom_matrices->size, NULL, GL_STATIC_DRAW);
-		glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-
+			this->commom_matrices->size = 2 * sizeof(glm::mat4);
+			glGenBuffers(1, &this->commom_matrices->ubo);
+			glBindBuffer(GL_UNIFORM_BUFFER, this->commom_matrices->ubo);
+			glBufferData(GL_UNIFORM_BUFFER, this->commom_matrices->size, NULL, GL_STATIC_DRAW);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		}
 	}
-	else
-		throw std::runtime_error("Could not initialize GLAD!");
-
 
-	// Set up the view port
-	glViewport(0, 0, w(), h());
+	// GPU time of the frame, the passes and what is in them
+	gpuProfiler.beginFrame();
 
+	// the view port and the clear belong to the passes of the frame graph
 	// clear the window, be sure to clear the Z-Buffer too
 	glClearColor(0, 0, .3f, 0);		// background should be blue
 
 	// we need to clear out the stencil buffer since we'll use
 	// it for shadows
 	glClearStencil(0);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 	glEnable(GL_DEPTH);
 
 	// Blayne prefers GL_DIFFUSE
@@ -290,7 +366,7 @@ void TrainView::draw()
 	glEnable(GL_LIGHT0);
 
 	// top view only needs one light
-	if (tw->topCam->value()) {
+	if (settings.topCam) {
 		glDisable(GL_LIGHT1);
 		glDisable(GL_LIGHT2);
 	}
@@ -357,72 +433,440 @@ void TrainView::draw()
 
 	setupObjects();
 
-	// drawStuff();
+	glBindBufferRange(
+		GL_UNIFORM_BUFFER, /*binding point*/0, this->commom_matrices->ubo, 0, this->commom_matrices->size);
+
+	glEnable(GL_CLIP_DISTANCE0);
+	glEnable(GL_BLEND);
 
-	// this time drawing is for shadows (except for top view)
-	if (!tw->topCam->value()) {
-		setupShadows();
-		drawStuff(true);
-		unsetupShadows();
+	// scale the water targets to keep their passes within budget
+	// (unless deterministic - then they stay where they are)
+	if (!deterministic) {
+		if (reflectionTimer.poll() && reflectionResolution.update(reflectionTimer.getMilliseconds()))
+			fbos->reflectionScale = reflectionResolution.scale;
+		if (refractionTimer.poll() && refractionResolution.update(refractionTimer.getMilliseconds()))
+			fbos->refractionScale = refractionResolution.scale;
+		if (layeredTimer.poll() && layeredResolution.update(layeredTimer.getMilliseconds()))
+			fbos->layeredScale = layeredResolution.scale;
 	}
+	fbos->layered = layeredPrepass;
 
-	setUBO();
-	glBindBufferRange(
-		GL_UNIFORM_BUFFER, /*binding point*/0, this->commom_matrices->ubo, 0, this->commom_matrices->size);
+	// the water targets follow the window size (recreated only on resize)
+	bool recreated;
+	{
+		GpuMemory::Owner owner("water targets");
+		recreated = fbos->resize(pixel_w(), pixel_h());
+	}
 
+	// is there any water to see? first the bounds against the frustum,
+	// then last frame's occlusion query if it has come back yet
+	bool water = settings.wave == 1 || settings.wave == 2;
+	if (water) {
+		glm::vec3 box_min, box_max;
+		getWaterBounds(box_min, box_max);
+		water = camera.isBoxVisible(box_min, box_max);
+	}
+	if (waterQueryPending) {
+		GLint available = 0;
+		glGetQueryObjectiv(waterQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint samples = 0;
+			glGetQueryObjectuiv(waterQuery, GL_QUERY_RESULT, &samples);
+			waterOccluded = samples == 0;
+			waterQueryPending = false;
+		}
+	}
+	if (!water || !waterOcclusion || deterministic)
+		waterOccluded = false;
+
+	// the prepasses only feed the water. when it was hidden behind the
+	// scene last frame the water pass still runs to keep the query going,
+	// but without the prepasses it has nothing to draw with: the water
+	// waits for the frame after the query sees it again (a frame late
+	// rather than with old or undefined textures)
+	bool prepasses = water && !waterOccluded;
+	waterWaits = water && !prepasses;
+	if (!prepasses)
+		reflectionValid = false;
+
+	// the reflection is amortised over frames, the refraction isn't. on
+	// frames that skip the reflection only the refraction is drawn, on its
+	// own, and the reflection stays wherever it was drawn last
+	// screen space reflection needs no reflection prepass, only the copy
+	// of the scene and its depth pyramid
+	bool planar = reflectionMode == 0;
+	bool updateReflection = planar && prepasses && (reflectionNeedsUpdate() || recreated);
+	if (!planar)
+		reflectionValid = false;
+	if (!planar && prepasses) {
+		GpuMemory::Owner owner("depth pyramid");
+		depthPyramid->resize(pixel_w(), pixel_h());
+	}
+	if (updateReflection) {
+		reflectionValid = true;
+		reflectionLayered = layeredPrepass;
+		reflectionFrame = frameNumber;
+		reflectionPosition = camera.position;
+		reflectionForward = glm::vec3(camera.view[0][2], camera.view[1][2], camera.view[2][2]);
+		multMatrix(&camera.projection[0][0], &camera.reflectedView[0][0], &reflectionViewProjection[0][0]);
+	}
+	bool layeredNow = layeredPrepass && updateReflection;
+	frameNumber++;
+
+	// the frame graph orders the passes and culls the water prepasses
+	// when there is no water to draw
+	frameGraph->setTarget(backbufferTarget, outputFramebuffer, 0, pixel_w(), pixel_h());
+	frameGraph->setTarget(reflectionTarget, fbos->reflectionFrameBuffer, fbos->reflectionTexture,
+		fbos->REFLECTION_WIDTH, fbos->REFLECTION_HEIGHT);
+	frameGraph->setTextureSize(refractionTarget, fbos->REFRACTION_WIDTH, fbos->REFRACTION_HEIGHT);
+	frameGraph->setTextureSize(refractionDepthTarget, fbos->REFRACTION_WIDTH, fbos->REFRACTION_HEIGHT);
+	frameGraph->setTarget(layeredTarget, fbos->layeredFrameBuffer, fbos->layeredColorArray,
+		fbos->LAYERED_WIDTH, fbos->LAYERED_HEIGHT);
+	frameGraph->setTarget(sceneCaptureTarget, 0, depthPyramid->colorTexture, pixel_w(), pixel_h());
+	frameGraph->setTarget(pyramidTarget, 0, depthPyramid->pyramidTexture,
+		pixel_w(), pixel_h());
+	frameGraph->setEnabled(pyramidPass, !planar && prepasses);
+	frameGraph->setEnabled(reflectionPass, !layeredPrepass && updateReflection);
+	frameGraph->setEnabled(refractionPass, prepasses && !layeredNow);
+	frameGraph->setEnabled(layeredPass, layeredNow);
+	frameGraph->setEnabled(waterPass, water);
+	// (compiled now for the refraction textures, execute doesn't again)
+	frameGraph->compile();
+	fbos->sampleFrom(reflectionLayered, layeredNow, frameGraph->getTexture(refractionTarget),
+		frameGraph->getTexture(refractionDepthTarget));
+	if (showHud)
+		drawStats.begin();
+	frameGraph->execute();
+	gpuProfiler.endFrame();
+	if (showHud)
+		drawStats.end();
+
+	if (capture)
+		capture->capture(outputFramebuffer, pixel_w(), pixel_h());
 
-	//// calculate view matrixglm::mat4 view_matrix;
-	glm::mat4 view_matrix, view_matrix_rotation, view_matrix_translation(1.0f);
-	glGetFloatv(GL_MODELVIEW_MATRIX, &view_matrix[0][0]);
+	// monitor to debug
+	// drawMonitor(1);
 
-	glm::mat4 view_matrix_inv = glm::inverse(view_matrix);
-	view_matrix_rotation = view_matrix;
-	view_matrix_rotation[3][0] = view_matrix_rotation[3][1] = view_matrix_rotation[3][2] = 0.0f;
-	view_matrix_translation[3] = glm::vec4(-view_matrix_inv[3][0], view_matrix_inv[3][1]*0.75f, -view_matrix_inv[3][2], 1.0f);
-	view_matrix_rotation[1] = -view_matrix_rotation[1];
-	new_view_matrix = view_matrix_rotation * view_matrix_translation;
+	// the overlay goes over the frame after the capture - it isn't part
+	// of the picture
+	if (showHud)
+		drawHud();
 
+	// a log line when the GPU memory moves (see GpuMemory)
+	GpuMemory::frame();
+}
 
+//************************************************************************
+//
+// * Does the reflection have to be drawn again this frame? the last one
+//   can be reused (reprojected) for a few frames as long as the camera
+//   stays close to where it was drawn from
+//========================================================================
+bool TrainView::
+reflectionNeedsUpdate()
+//========================================================================
+{
+	if (!reflectionValid || reflectionLayered != layeredPrepass)
+		return true;
+	if (reflectionInterval <= 1 || frameNumber - reflectionFrame >= (unsigned int)reflectionInterval)
+		return true;
+
+	if (glm::distance(camera.position, reflectionPosition) > reflectionMoveThreshold)
+		return true;
+	glm::vec3 forward(camera.view[0][2], camera.view[1][2], camera.view[2][2]);
+	return glm::dot(forward, reflectionForward) < reflectionTurnThreshold;
+}
+
+//************************************************************************
+//
+// * World space box around the water grid, waves included
+//========================================================================
+void TrainView::
+getWaterBounds(glm::vec3& box_min, glm::vec3& box_max)
+//========================================================================
+{
+	// the grid is [-1, 1] on x and z at WATER_HEIGHT, scaled by 100 around
+	// source_pos. the height map moves it by at most 0.25, the sine wave
+	// by its amplitude / wave number
+	float wave = 0.25f;
+	if (settings.wave == 1) {
+		float k = 2.0f * 3.14159f / settings.waveLength;
+		wave = glm::max(wave, settings.amplitude / k);
+	}
+
+	box_min = this->source_pos + 100.0f * glm::vec3(-1.0f, WATER_HEIGHT - wave, -1.0f);
+	box_max = this->source_pos + 100.0f * glm::vec3(1.0f, WATER_HEIGHT + wave, 1.0f);
+}
+
+//************************************************************************
+//
+// * A [-1, 1] cube and a flat shader, to draw bounding boxes into
+//   occlusion queries
+//========================================================================
+void TrainView::
+initBounds()
+//========================================================================
+{
+	GpuMemory::Owner owner("bounds");
+	if (this->boundsShader)
+		return;
+	this->boundsShader = new Shader(PROJECT_DIR "/src/shaders/boundsVS.glsl",
+		nullptr, nullptr, nullptr,
+		PROJECT_DIR "/src/shaders/boundsFS.glsl");
+
+	GLfloat boxVertices[] = {
+		-1.0f,  1.0f, -1.0f,
+		-1.0f, -1.0f, -1.0f,
+		 1.0f, -1.0f, -1.0f,
+		 1.0f, -1.0f, -1.0f,
+		 1.0f,  1.0f, -1.0f,
+		-1.0f,  1.0f, -1.0f,
+
+		-1.0f, -1.0f,  1.0f,
+		-1.0f, -1.0f, -1.0f,
+		-1.0f,  1.0f, -1.0f,
+		-1.0f,  1.0f, -1.0f,
+		-1.0f,  1.0f,  1.0f,
+		-1.0f, -1.0f,  1.0f,
+
+		 1.0f, -1.0f, -1.0f,
+		 1.0f, -1.0f,  1.0f,
+		 1.0f,  1.0f,  1.0f,
+		 1.0f,  1.0f,  1.0f,
+		 1.0f,  1.0f, -1.0f,
+		 1.0f, -1.0f, -1.0f,
+
+		-1.0f, -1.0f,  1.0f,
+		-1.0f,  1.0f,  1.0f,
+		 1.0f,  1.0f,  1.0f,
+		 1.0f,  1.0f,  1.0f,
+		 1.0f, -1.0f,  1.0f,
+		-1.0f, -1.0f,  1.0f,
+
+		-1.0f,  1.0f, -1.0f,
+		 1.0f,  1.0f, -1.0f,
+		 1.0f,  1.0f,  1.0f,
+		 1.0f,  1.0f,  1.0f,
+		-1.0f,  1.0f,  1.0f,
+		-1.0f,  1.0f, -1.0f,
+
+		-1.0f, -1.0f, -1.0f,
+		-1.0f, -1.0f,  1.0f,
+		 1.0f, -1.0f, -1.0f,
+		 1.0f, -1.0f, -1.0f,
+		-1.0f, -1.0f,  1.0f,
+		 1.0f, -1.0f,  1.0f
+	};
+
+	glGenVertexArrays(1, &boxVAO);
+	glGenBuffers(1, &boxVBO);
+	glBindVertexArray(boxVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(boxVertices), &boxVertices, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	glBindVertexArray(0);
+}
+
+//************************************************************************
+//
+// * Draw the water bounds into an occlusion query, without touching the
+//   color or depth buffer. returns false if no query was issued - when
+//   the camera is inside the box the faces may all be clipped away
+//========================================================================
+bool TrainView::
+queryWaterBounds()
+//========================================================================
+{
+	glm::vec3 box_min, box_max;
+	getWaterBounds(box_min, box_max);
+	if (glm::all(glm::greaterThanEqual(camera.position, box_min)) &&
+		glm::all(glm::lessThanEqual(camera.position, box_max))) {
+		this->waterQueryPending = false;
+		this->waterOccluded = false;
+		return false;
+	}
+
+	if (!this->waterQuery)
+		glGenQueries(1, &this->waterQuery);
+
+	// the cube is [-1, 1], stretch it over the box
+	glm::mat4 model_matrix = glm::translate(glm::mat4(), (box_min + box_max) * 0.5f);
+	model_matrix = glm::scale(model_matrix, (box_max - box_min) * 0.5f);
+	glm::mat4 mvp = camera.viewProjection * model_matrix;
+
+	this->boundsShader->Use();
+	glUniformMatrix4fv(glGetUniformLocation(this->boundsShader->Program, "u_mvp"), 1, GL_FALSE, &mvp[0][0]);
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, this->waterQuery);
+	glBindVertexArray(boxVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 36);
+	glBindVertexArray(0);
+	glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+	glDepthMask(GL_TRUE);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glUseProgram(0);
+
+	this->waterQueryPending = true;
+	return true;
+}
+
+//************************************************************************
+//
+// * Set up the passes of a frame. the graph is built once, each frame
+//   only updates the targets and which passes are wanted
+//========================================================================
+void TrainView::
+initFrameGraph()
+//========================================================================
+{
+	GpuMemory::Owner owner("frame graph");
+	if (this->frameGraph)
+		return;
+
+	this->frameGraph = new FrameGraph();
+	FrameGraph& graph = *this->frameGraph;
+
+	backbufferTarget = graph.importTarget("backbuffer", outputFramebuffer, 0, pixel_w(), pixel_h(), true);
+	reflectionTarget = graph.importTarget("reflection", fbos->reflectionFrameBuffer, fbos->reflectionTexture,
+		fbos->REFLECTION_WIDTH, fbos->REFLECTION_HEIGHT);
+	// the refraction isn't kept from frame to frame like the reflection,
+	// it can live in the graph's pool
+	FrameGraph::TextureDesc refraction = { (int)fbos->REFRACTION_WIDTH, (int)fbos->REFRACTION_HEIGHT, GL_RGB8 };
+	refractionTarget = graph.createTexture("refraction", refraction);
+	refraction.internalFormat = GL_DEPTH_COMPONENT32F;
+	refractionDepthTarget = graph.createTexture("refraction depth", refraction);
+	layeredTarget = graph.importTarget("layers", fbos->layeredFrameBuffer, fbos->layeredColorArray,
+		fbos->LAYERED_WIDTH, fbos->LAYERED_HEIGHT);
+	// copy of the finished scene and the depth pyramid built from it, for
+	// screen space reflection
+	sceneCaptureTarget = graph.importTarget("scene capture", 0, depthPyramid->colorTexture, pixel_w(), pixel_h());
+	// (built by compute, the pass has no framebuffer of its own)
+	pyramidTarget = graph.importTarget("depth pyramid", 0, depthPyramid->pyramidTexture,
+		pixel_w(), pixel_h());
+
+	// every pass that runs is a scope of the GPU profiler, and its CPU
+	// time (the time it takes to send its work) goes to the overlay
+	graph.setPassHook([this](FrameGraph::Pass pass, bool begin) {
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		if (begin) {
+			hudPassBegin = seconds;
+			gpuProfiler.push(frameGraph->getName(pass));
+		}
+		else {
+			gpuProfiler.pop();
+			double milliseconds = (seconds - hudPassBegin) * 1000.0;
+			double* average = findHudPassCpu(frameGraph->getName(pass));
+			if (!average) {
+				HudPassTime time = { frameGraph->getName(pass), milliseconds };
+				hudPassCpu.push_back(time);
+			}
+			else
+				*average += 0.1 * (milliseconds - *average);
+		}
+	});
 
-	glEnable(GL_CLIP_DISTANCE0);
 	/*
 	// renderScene - mode
 		0: Don't clip
 		1: Clip for reflection
 		2: Clip for refraction
+		3: Both at once, into the two layers of one target
 	*/
 	// reflection 
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-	glMultMatrixf(&new_view_matrix[0][0]);
-	glEnable(GL_BLEND);
-	
-	fbos->bindReflectionFrameBuffer();
-	drawSphere();
-	renderScene(1);
-	fbos->unbindCurrentFrameBuffer();
+	reflectionPass = graph.addPass("reflection", [this]() {
+		reflectionTimer.begin();
+		renderScene(1);
+		reflectionTimer.end();
+	});
+	graph.write(reflectionPass, reflectionTarget);
+	graph.setClear(reflectionPass, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	drawSphere();
 	// refraction
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-	glMultMatrixf(&view_matrix[0][0]);
-	fbos->bindRefractionFrameBuffer();
-	renderScene(2);
-	fbos->unbindCurrentFrameBuffer();
-
-	// monitor to debug
-	// drawMonitor(1);
-
+	refractionPass = graph.addPass("refraction", [this]() {
+		glMatrixMode(GL_MODELVIEW);
+		glLoadMatrixf(&camera.view[0][0]);
+		refractionTimer.begin();
+		renderScene(2);
+		refractionTimer.end();
+	});
+	graph.write(refractionPass, refractionTarget);
+	graph.write(refractionPass, refractionDepthTarget);
+	graph.setClear(refractionPass, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// reflection and refraction together - only one walk over the scene
+	layeredPass = graph.addPass("layered", [this]() {
+		// the debug sphere doesn't pick a layer, it lands in layer 0
+		// which is the reflection
+		layeredTimer.begin();
+		renderScene(3);
+		layeredTimer.end();
+	});
+	graph.write(layeredPass, layeredTarget);
+	graph.setClear(layeredPass, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	// draw scene
-	renderScene(0);
-	if (tw->waveBrowser->value() == 1)
-		drawSineWater();
-	else if (tw->waveBrowser->value() == 2)
-		drawHeightWater();
+	scenePass = graph.addPass("scene", [this]() {
+		// this time drawing is for shadows (except for top view)
+		glMatrixMode(GL_MODELVIEW);
+		glLoadMatrixf(&camera.view[0][0]);
+		if (!settings.topCam) {
+			GpuProfiler::Scope scope(gpuProfiler, "shadows");
+			setupShadows();
+			drawStuff(true);
+			unsetupShadows();
+		}
 
+		renderScene(0);
 
+		// screen space reflection marches over a copy of this (the water
+		// can't sample the framebuffer it draws into)
+		if (!frameGraph->isCulled(pyramidPass)) {
+			GpuProfiler::Scope scope(gpuProfiler, "capture");
+			depthPyramid->capture();
+		}
+	});
+	graph.write(scenePass, backbufferTarget);
+	graph.write(scenePass, sceneCaptureTarget);
+	graph.setClear(scenePass, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+	// min/max depth pyramid of the captured scene
+	pyramidPass = graph.addPass("depth pyramid", [this]() {
+		depthPyramid->build();
+	});
+	graph.read(pyramidPass, sceneCaptureTarget);
+	graph.write(pyramidPass, pyramidTarget);
+
+	// water on top of the scene
+	waterPass = graph.addPass("water", [this]() {
+		// the bounds are tested against the finished scene, the water
+		// itself is only drawn if some of them passed
+		bool conditional = false;
+		if (waterOcclusion) {
+			GpuProfiler::Scope scope(gpuProfiler, "bounds");
+			conditional = queryWaterBounds();
+		}
+		if (waterWaits)
+			return;
+		if (conditional)
+			glBeginConditionalRender(waterQuery, GL_QUERY_BY_REGION_WAIT);
+		glm::vec3 box_min, box_max;
+		getWaterBounds(box_min, box_max);
+		drawList.begin(camera.view);
+		drawList.add(DrawList::BUCKET_BLENDED, box_min, box_max,
+			[](void* view, int) { ((TrainView*)view)->drawWater(); }, this);
+		drawList.draw();
+		if (conditional)
+			glEndConditionalRender();
+	});
+	graph.read(waterPass, reflectionTarget);
+	graph.read(waterPass, refractionTarget);
+	graph.read(waterPass, refractionDepthTarget);
+	graph.read(waterPass, layeredTarget);
+	graph.read(waterPass, pyramidTarget);
+	graph.write(waterPass, backbufferTarget);
 }
 
 //************************************************************************
@@ -438,14 +882,16 @@ setProjection()
 	// Compute the aspect ratio (we'll need it)
 	float aspect = static_cast<float>(w()) / static_cast<float>(h());
 
+	glm::mat4 view_matrix;
+	glm::mat4 projection_matrix;
+
 	// Check whether we use the world camp
-	if (tw->worldCam->value())
+	if (settings.worldCam)
 	{
-		arcball.setProjection(false);
-		//reflectArcball.setProjection(false);
+		arcball.getMatrices(aspect, view_matrix, projection_matrix);
 	}
 	// Or we use the top cam
-	else if (tw->topCam->value()) {
+	else if (settings.topCam) {
 		float wi, he;
 		if (aspect >= 1) {
 			wi = 110;
@@ -458,11 +904,8 @@ setProjection()
 
 		// Set up the top camera drop mode to be orthogonal and set
 		// up proper projection matrix
-		glMatrixMode(GL_PROJECTION);
-		glOrtho(-wi, wi, -he, he, 200, -200);
-		glMatrixMode(GL_MODELVIEW);
-		glLoadIdentity();
-		glRotatef(-90, 1, 0, 0);
+		projection_matrix = glm::ortho(-wi, wi, -he, he, 200.0f, -200.0f);
+		view_matrix = glm::rotate(glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 	}
 	// Or do the train view or other view here
 	//####################################################################
@@ -473,8 +916,19 @@ setProjection()
 #ifdef EXAMPLE_SOLUTION
 		trainCamView(this, aspect);
 #endif
+		return;
 	}
 
+	// keep the matrices on the CPU so nothing has to read them back
+	camera.set(view_matrix, projection_matrix);
+	camera.setReflectionPlane(this->source_pos.y + WATER_HEIGHT * 100.0f);
+
+	// getMouseLine still reads the matrix stacks back, so hand them the
+	// same matrices
+	glMatrixMode(GL_PROJECTION);
+	glMultMatrixf(&camera.projection[0][0]);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadMatrixf(&camera.view[0][0]);
 }
 
 //************************************************************************
@@ -494,16 +948,17 @@ void TrainView::drawStuff(bool doingShadows)
 	// Draw the control points
 	// don't draw the control points if you're driving 
 	// (otherwise you get sea-sick as you drive through them)
-	if (!tw->trainCam->value()) {
-		for (size_t i = 0; i < m_pTrack->points.size(); ++i) {
-			if (!doingShadows) {
-				if (((int)i) != selectedCube)
-					glColor3ub(240, 60, 60);
-				else
-					glColor3ub(240, 240, 30);
-			}
-			m_pTrack->points[i].draw();
+	// all of them in one instanced draw
+	if (!settings.trainCam) {
+		updateControlPointMarkers();
+		glm::mat4 view_projection = camera.viewProjection;
+		if (doingShadows) {
+			// the squish of setupShadows, onto the floor
+			glm::mat4 flatten;
+			flatten[1][1] = 0.0f;
+			view_projection = view_projection * flatten;
 		}
+		markers->draw(InstancedMarkers::CONTROL_POINT, view_projection, doingShadows);
 	}
 	// draw the track
 	//####################################################################
@@ -544,71 +999,67 @@ doPick()
 //========================================================================
 {
 	// since we'll need to do some GL stuff so we make this window as 
-	// active window
-	make_current();
-
-	// where is the mouse?
-	int mx = Fl::event_x();
-	int my = Fl::event_y();
+	// active window (headless - a replay - the context is current already)
+	if (shown())
+		make_current();
+	if (!this->glLoaded)
+		return;
+	if (!this->pickBuffer) {
+		GpuMemory::Owner owner("pick buffer");
+		this->pickBuffer = new PickBuffer();
+	}
 
-	// get the viewport - most reliable way to turn mouse coords into GL coords
-	int viewport[4];
-	glGetIntegerv(GL_VIEWPORT, viewport);
+	// where is the mouse? in pixels, and remember, FlTk is upside down!
+	float scale = static_cast<float>(pixel_w()) / static_cast<float>(w());
+	int mx = static_cast<int>(Fl::event_x() * scale);
+	int my = pixel_h() - 1 - static_cast<int>(Fl::event_y() * scale);
 
-	// Set up the pick matrix on the stack - remember, FlTk is
-	// upside down!
+	// the same matrices the frame was drawn with
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
-	gluPickMatrix((double)mx, (double)(viewport[3] - my),
-		5, 5, viewport);
-
-	// now set up the projection
 	setProjection();
 
-	// now draw the objects - but really only see what we hit
-	GLuint buf[100];
-	glSelectBuffer(100, buf);
-	glRenderMode(GL_SELECT);
-	glInitNames();
-	glPushName(0);
-
-	// draw the cubes, loading the names as we go
-	for (size_t i = 0; i < m_pTrack->points.size(); ++i) {
-		glLoadName((GLuint)(i + 1));
-		m_pTrack->points[i].draw();
-	}
+	// draw the ids of everything pickable around the mouse, the nearest
+	// one ends up under it. the id is read back without waiting for it,
+	// resolvePick picks it up
+	glm::mat4 region = this->pickBuffer->begin(mx, my, pixel_w(), pixel_h());
+	updateControlPointMarkers();
+	markers->drawIds(InstancedMarkers::CONTROL_POINT, region * camera.projection * camera.view,
+		PICK_CONTROL_POINTS);
+	this->pickBuffer->end();
+}
 
-	// go back to drawing mode, and see how picking did
-	int hits = glRenderMode(GL_RENDER);
-	if (hits) {
-		// warning; this just grabs the first object hit - if there
-		// are multiple objects, you really want to pick the closest
-		// one - see the OpenGL manual 
-		// remember: we load names that are one more than the index
-		selectedCube = buf[3] - 1;
-	}
+//************************************************************************
+//
+// * Take the result of the last doPick if it has arrived - or wait for it
+//========================================================================
+void TrainView::
+resolvePick(bool wait)
+//========================================================================
+{
+	if (!this->pickBuffer || !this->pickBuffer->pending())
+		return;
+	if (shown())
+		make_current();
+
+	GLuint id;
+	if (!this->pickBuffer->result(id, wait))
+		return;
+
+	// remember: the ids of the control points are one more than the index
+	if (id >= PICK_CONTROL_POINTS && id < PICK_CONTROL_POINTS + m_pTrack->points.size())
+		selectedCube = (int)(id - PICK_CONTROL_POINTS);
 	else // nothing hit, nothing selected
 		selectedCube = -1;
 
 	printf("Selected Cube %d\n", selectedCube);
+	damage(1);
 }
 
-void TrainView::setUBO()
+void TrainView::setUBO(const glm::mat4& view_matrix)
 {
-	float wdt = this->pixel_w();
-	float hgt = this->pixel_h();
-
-	glm::mat4 view_matrix;
-	glGetFloatv(GL_MODELVIEW_MATRIX, &view_matrix[0][0]);
-	//HMatrix view_matrix; 
-	//this->arcball.getMatrix(view_matrix);
-
-	glm::mat4 projection_matrix;
-	glGetFloatv(GL_PROJECTION_MATRIX, &projection_matrix[0][0]);
-	//projection_matrix = glm::perspective(glm::radians(this->arcball.getFoV()), (GLfloat)wdt / (GLfloat)hgt, 0.01f, 1000.0f);
-
 	glBindBuffer(GL_UNIFORM_BUFFER, this->commom_matrices->ubo);
-	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), &projection_matrix[0][0]);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), &camera.projection[0][0]);
 	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), &view_matrix[0][0]);
 	glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
@@ -616,73 +1067,21 @@ void TrainView::setUBO()
 void TrainView::
 initSkyboxShader()
 {
+	GpuMemory::Owner owner("skybox");
 	if (!skyboxShader) {
 		this->skyboxShader = new Shader(PROJECT_DIR "/src/shaders/skyboxVS.glsl",
 			nullptr, nullptr, nullptr,
 			PROJECT_DIR "/src/shaders/skyboxFS.glsl");
 
-		GLfloat skyboxVertices[] = {
+		// the sky is one full screen triangle made up in the vertex
+		// shader, it only needs an empty VAO bound
+		glGenVertexArrays(1, &emptyVAO);
 
-			-1.0f,  1.0f, -1.0f,
-			-1.0f, -1.0f, -1.0f,
-			 1.0f, -1.0f, -1.0f,
-			 1.0f, -1.0f, -1.0f,
-			 1.0f,  1.0f, -1.0f,
-			-1.0f,  1.0f, -1.0f,
-
-			-1.0f, -1.0f,  1.0f,
-			-1.0f, -1.0f, -1.0f,
-			-1.0f,  1.0f, -1.0f,
-			-1.0f,  1.0f, -1.0f,
-			-1.0f,  1.0f,  1.0f,
-			-1.0f, -1.0f,  1.0f,
-
-			 1.0f, -1.0f, -1.0f,
-			 1.0f, -1.0f,  1.0f,
-			 1.0f,  1.0f,  1.0f,
-			 1.0f,  1.0f,  1.0f,
-			 1.0f,  1.0f, -1.0f,
-			 1.0f, -1.0f, -1.0f,
-
-			-1.0f, -1.0f,  1.0f,
-			-1.0f,  1.0f,  1.0f,
-			 1.0f,  1.0f,  1.0f,
-			 1.0f,  1.0f,  1.0f,
-			 1.0f, -1.0f,  1.0f,
-			-1.0f, -1.0f,  1.0f,
-
-			-1.0f,  1.0f, -1.0f,
-			 1.0f,  1.0f, -1.0f,
-			 1.0f,  1.0f,  1.0f,
-			 1.0f,  1.0f,  1.0f,
-			-1.0f,  1.0f,  1.0f,
-			-1.0f,  1.0f, -1.0f,
-
-			-1.0f, -1.0f, -1.0f,
-			-1.0f, -1.0f,  1.0f,
-			 1.0f, -1.0f, -1.0f,
-			 1.0f, -1.0f, -1.0f,
-			-1.0f, -1.0f,  1.0f,
-			 1.0f, -1.0f,  1.0f
-		};
-
-		//glGenVertexArrays(1, &this->skybox->vao);
-		//glGenBuffers(1, this->skybox->vbo);
-
-		//glBindVertexArray(this->skybox->vao);
-		//glBindBuffer(GL_ARRAY_BUFFER, this->skybox->vbo[0]);
-		//glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
-		//glEnableVertexAttribArray(0);
-		//glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-
-		// skybox VAO
-		glGenVertexArrays(1, &skyboxVAO);
-		glGenBuffers(1, &skyboxVBO);
-		glBindVertexArray(skyboxVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+		skyboxShader->Use();
+		glUniform1i(glGetUniformLocation(this->skyboxShader->Program, "skybox"), 0);
+		skyboxInverseViewProjectionLocation =
+			glGetUniformLocation(this->skyboxShader->Program, "inverseViewProjection");
+		glUseProgram(0);
 
 		// load textures
 		vector<std::string> faces;
@@ -699,63 +1098,178 @@ initSkyboxShader()
 unsigned int TrainView::
 loadCubemap(std::vector<std::string> faces)
 {
+	PROFILE_ZONE("TrainView::loadCubemap");
+	// decoding the jpgs is most of the work - do the faces in parallel
+	std::vector<std::future<unsigned char*>> decoded;
+	std::vector<int> width(faces.size()), height(faces.size());
+	for (unsigned int i = 0; i < faces.size(); i++)
+	{
+		decoded.push_back(std::async(std::launch::async, [&faces, &width, &height, i]() {
+			PROFILE_THREAD("cubemap decode");
+			PROFILE_ZONE("stbi_load");
+			int nrComponents;
+			return stbi_load(faces[i].c_str(), &width[i], &height[i], &nrComponents, 3);
+		}));
+	}
+
+	std::vector<unsigned char*> data;
+	for (unsigned int i = 0; i < faces.size(); i++)
+	{
+		data.push_back(decoded[i].get());
+		if (!data[i])
+			std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
+	}
+
 	unsigned int textureID;
 	glGenTextures(1, &textureID);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-	int width, height, nrComponents;
-	for (unsigned int i = 0; i < faces.size(); i++)
+	// immutable storage with the whole mip chain, all faces the size of
+	// the first one that loaded
+	int size = 0;
+	for (unsigned int i = 0; i < faces.size() && !size; i++)
+		if (data[i])
+			size = width[i];
+	int levels = 1;
+	while ((size >> levels) > 0)
+		levels++;
+	if (size)
 	{
-		unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrComponents, 0);
-		if (data)
-		{
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			stbi_image_free(data);
-		}
-		else
-		{
-			std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-			stbi_image_free(data);
-		}
+		glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels, GL_RGB8, size, size);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (unsigned int i = 0; i < faces.size(); i++)
+			if (data[i] && width[i] == size && height[i] == size)
+				glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 0, 0, size, size, GL_RGB, GL_UNSIGNED_BYTE, data[i]);
+			else if (data[i])
+				std::cout << "Cubemap face " << faces[i] << " is not " << size << "x" << size << std::endl;
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
 	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	for (unsigned int i = 0; i < faces.size(); i++)
+		stbi_image_free(data[i]);
+
+	// trilinear
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	// no seams between the faces at the smaller mips
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
 	return textureID;
 }
 
+// the sky is drawn last, at the far plane, only where nothing else was
+// drawn (depth still cleared) - so it never shades a pixel twice
 void TrainView::
-drawSkybox()
+drawSkybox(const glm::mat4& view_matrix)
 {
-	glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
+	glDepthFunc(GL_EQUAL);
+	glDepthMask(GL_FALSE);
 	skyboxShader->Use();
-	glUniform1i(glGetUniformLocation(this->skyboxShader->Program, "skybox"), 0);
-	glm::mat4 view;
-	glm::mat4 projection;
+	glm::mat4 view = glm::mat4(glm::mat3(view_matrix)); // remove translation from the view matrix
+	// inverse(projection * view) = inverse(view) * inverse(projection),
+	// and the view is only a rotation (and the mirror of the reflection)
+	glm::mat4 inverse_view, inverse_view_projection;
+	invertAffine(&view[0][0], &inverse_view[0][0]);
+	multMatrix(&inverse_view[0][0], &camera.inverseProjection[0][0], &inverse_view_projection[0][0]);
+	glUniformMatrix4fv(skyboxInverseViewProjectionLocation, 1, GL_FALSE, &inverse_view_projection[0][0]);
+
+	// one full screen triangle
+	glBindVertexArray(emptyVAO);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS); // set depth function back to default
+}
+
+//************************************************************************
+//
+// * Shaders for the layered water prepass. they take the view of each
+//   layer from the layered_matrices UBO (binding point 1)
+//========================================================================
+void TrainView::
+initLayeredShaders()
+//========================================================================
+{
+	GpuMemory::Owner owner("layered");
+	if (!this->tilesLayeredShader)
+		this->tilesLayeredShader = new
+		Shader(
+			PROJECT_DIR "/src/shaders/tilesLayered.vert",
+			nullptr, nullptr,
+			PROJECT_DIR "/src/shaders/tilesLayered.geom",
+			PROJECT_DIR "/src/shaders/tiles.frag");
 
-	glGetFloatv(GL_MODELVIEW_MATRIX, &view[0][0]);
-	glGetFloatv(GL_PROJECTION_MATRIX, &projection[0][0]);
-	view = glm::mat4(glm::mat3(view)); // remove translation from the view matrix
+	if (!this->skyboxLayeredShader)
+		this->skyboxLayeredShader = new
+		Shader(
+			PROJECT_DIR "/src/shaders/skyboxLayeredVS.glsl",
+			nullptr, nullptr,
+			PROJECT_DIR "/src/shaders/skyboxLayeredGS.glsl",
+			PROJECT_DIR "/src/shaders/skyboxFS.glsl");
+	this->skyboxLayeredShader->Use();
+	glUniform1i(glGetUniformLocation(this->skyboxLayeredShader->Program, "skybox"), 0);
+	glUseProgram(0);
 
-	glGetFloatv(GL_PROJECTION_MATRIX, &projection[0][0]);
-	glUniformMatrix4fv(glGetUniformLocation(this->skyboxShader->Program, "view"), 1, GL_FALSE, &view[0][0]);
-	glUniformMatrix4fv(glGetUniformLocation(this->skyboxShader->Program, "projection"), 1, GL_FALSE, &projection[0][0]);
+	if (!this->layered_matrices) {
+		// projection, a view per layer, a clip plane per layer (std140)
+		this->layered_matrices = new UBO();
+		this->layered_matrices->size = 3 * sizeof(glm::mat4) + 2 * sizeof(glm::vec4);
+		glGenBuffers(1, &this->layered_matrices->ubo);
+		glBindBuffer(GL_UNIFORM_BUFFER, this->layered_matrices->ubo);
+		glBufferData(GL_UNIFORM_BUFFER, this->layered_matrices->size, NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+}
 
-	// skybox cube
-	glBindVertexArray(skyboxVAO);
+void TrainView::
+setLayeredUBO()
+{
+	struct {
+		glm::mat4 projection;
+		glm::mat4 view[2];
+		glm::vec4 clipPlane[2];
+	} data;
+	data.projection = camera.projection;
+	data.view[0] = camera.reflectedView;
+	data.view[1] = camera.view;
+	// same planes as tiles.vert: reflection keeps what is above the water
+	// (in model space), refraction isn't clipped
+	data.clipPlane[0] = glm::vec4(0.0f, 1.0f, 0.0f, -WATER_HEIGHT);
+	data.clipPlane[1] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, this->layered_matrices->ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(data), &data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferRange(
+		GL_UNIFORM_BUFFER, /*binding point*/1, this->layered_matrices->ubo, 0, this->layered_matrices->size);
+}
+
+void TrainView::
+drawSkyboxLayered()
+{
+	// like drawSkybox, one full screen triangle per layer
+	glDepthFunc(GL_EQUAL);
+	glDepthMask(GL_FALSE);
+	skyboxLayeredShader->Use();
+
+	glBindVertexArray(emptyVAO);
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-	glDrawArrays(GL_TRIANGLES, 0, 36);
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 3, 2);
 	glBindVertexArray(0);
-	glDepthFunc(GL_LESS); // set depth function back to default
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
 }
 
 void TrainView::
 initTilesShader()
 {
+	GpuMemory::Owner owner("tiles");
 	if (!this->tilesShader)
 		this->tilesShader = new
 		Shader(
@@ -923,38 +1437,39 @@ void TrainView::
 drawTiles(int mode=0)
 {
 	//bind shader
-	this->tilesShader->Use();
-
-	setUBO();
+	Shader* shader = (mode == 3) ? this->tilesLayeredShader : this->tilesShader;
+	shader->Use();
 
 	glm::mat4 model_matrix = glm::mat4();
 	model_matrix = glm::translate(model_matrix, this->source_pos);
 	model_matrix = glm::scale(model_matrix, glm::vec3(100.0f, 100.0f, 100.0f));
 	glUniformMatrix4fv(
-		glGetUniformLocation(this->tilesShader->Program, "u_model"), 
+		glGetUniformLocation(shader->Program, "u_model"), 
 		1, 
 		GL_FALSE, 
 		&model_matrix[0][0]);
 	glUniform3fv(
-		glGetUniformLocation(this->tilesShader->Program, "u_color"),
+		glGetUniformLocation(shader->Program, "u_color"),
 		1,
 		&glm::vec3(0.0f, 1.0f, 0.0f)[0]);
 
 	this->tilesTexture->bind(0);
-	glUniform1i(glGetUniformLocation(this->tilesShader->Program, "u_texture"), 0);
+	glUniform1i(glGetUniformLocation(shader->Program, "u_texture"), 0);
 	
-	glUniform1i(glGetUniformLocation(this->tilesShader->Program, "clip_mode"), mode);
-
-	glUniformMatrix4fv(glGetUniformLocation(this->skyboxShader->Program, "new_view_matrix"), 1, GL_FALSE, &new_view_matrix[0][0]);
+	glUniform1i(glGetUniformLocation(shader->Program, "clip_mode"), mode);
 
-	glUniform1f(glGetUniformLocation(this->tilesShader->Program, "WATER_HEIGHT"), WATER_HEIGHT);
+	glUniform1f(glGetUniformLocation(shader->Program, "WATER_HEIGHT"), WATER_HEIGHT);
 	
 
 	//bind VAO
 	glBindVertexArray(this->tiles->vao);
 
 	//glEnable(GL_CLIP_DISTANCE0);
-	glDrawElements(GL_TRIANGLES, this->tiles->element_amount, GL_UNSIGNED_INT, 0);
+	// layered: one instance per layer
+	if (mode == 3)
+		glDrawElementsInstanced(GL_TRIANGLES, this->tiles->element_amount, GL_UNSIGNED_INT, 0, 2);
+	else
+		glDrawElements(GL_TRIANGLES, this->tiles->element_amount, GL_UNSIGNED_INT, 0);
 
 	//unbind VAO
 	glBindVertexArray(0);
@@ -963,133 +1478,165 @@ drawTiles(int mode=0)
 	glUseProgram(0);
 }
 
+//************************************************************************
+//
+// * The water grid: a quad every size across [-1, 1] x [-1, 1] at height,
+//   four vertices each (so every quad has its own texture coordinates).
+//   only fills the arrays - nothing here touches GL
+//========================================================================
 void TrainView::
-initSineWater()
+buildWaterGrid(float size, float height, std::vector<GLfloat>& vertices, std::vector<GLfloat>& texture_coordinate,
+	std::vector<GLuint>& element)
+//========================================================================
 {
-	if (!this->sineWaterShader)
-		this->sineWaterShader = new
-		Shader(
-			PROJECT_DIR "/src/shaders/sineVS.glsl",
-			nullptr, nullptr, nullptr,
-			PROJECT_DIR "/src/shaders/sineFS.glsl");
-
-	if (!this->sineWater) {
+	unsigned int width = (unsigned int)(2.0f / size);
+	unsigned int depth = (unsigned int)(2.0f / size);
 
-		float size = 0.01f;
-		unsigned int width = 2.0f / size;
-		unsigned int height = 2.0f / size;
+	vertices.assign(width * depth * 4 * 3, 0.0f);
+	texture_coordinate.assign(width * depth * 4 * 2, 0.0f);
+	element.assign(width * depth * 6, 0);
 
-		GLfloat* vertices = new GLfloat[width * height * 4 * 3]();
-		GLfloat* texture_coordinate = new GLfloat[width * height * 4 * 2]();
-		GLuint* element = new GLuint[width * height * 6]();
+	/*
+	 Vertices
+	*2 -- *3
+	 | \   |
+	 |  \  |
+	*1 -- *0
+	*/
+	for (unsigned int i = 0; i < width * depth * 4 * 3; i += 12)
+	{
+		unsigned int h = i / 12 / width;
+		unsigned int w = i / 12 % width;
+		//point 0
+		vertices[i] = w * size - 1.0f + size;
+		vertices[i + 1] = height;
+		vertices[i + 2] = h * size - 1.0f + size;
+		//point 1
+		vertices[i + 3] = vertices[i] - size;
+		vertices[i + 4] = height;
+		vertices[i + 5] = vertices[i + 2];
+		//point 2
+		vertices[i + 6] = vertices[i + 3];
+		vertices[i + 7] = height;
+		vertices[i + 8] = vertices[i + 5] - size;
+		//point 3
+		vertices[i + 9] = vertices[i];
+		vertices[i + 10] = height;
+		vertices[i + 11] = vertices[i + 8];
+	}
 
-		/*
-		 Vertices
-		*2 -- *3
-		 | \   |
-		 |  \  |
-		*1 -- *0
-		*/
-		for (int i = 0; i < width * height * 4 * 3; i += 12)
+	// texture
+	for (unsigned int i = 0; i < depth; i++)
+	{
+		for (unsigned int j = 0; j < width; j++)
 		{
-			unsigned int h = i / 12 / width;
-			unsigned int w = i / 12 % width;
 			//point 0
-			vertices[i] = w * size - 1.0f + size;
-			vertices[i + 1] = WATER_HEIGHT;
-			vertices[i + 2] = h * size - 1.0f + size;
+			texture_coordinate[i * width * 8 + j * 8 + 0] = (float)(j + 1) / width;
+			texture_coordinate[i * width * 8 + j * 8 + 1] = (float)(i + 1) / depth;
 			//point 1
-			vertices[i + 3] = vertices[i] - size;
-			vertices[i + 4] = WATER_HEIGHT;
-			vertices[i + 5] = vertices[i + 2];
+			texture_coordinate[i * width * 8 + j * 8 + 2] = (float)(j + 0) / width;
+			texture_coordinate[i * width * 8 + j * 8 + 3] = (float)(i + 1) / depth;
 			//point 2
-			vertices[i + 6] = vertices[i + 3];
-			vertices[i + 7] = WATER_HEIGHT;
-			vertices[i + 8] = vertices[i + 5] - size;
+			texture_coordinate[i * width * 8 + j * 8 + 4] = (float)(j + 0) / width;
+			texture_coordinate[i * width * 8 + j * 8 + 5] = (float)(i + 0) / depth;
 			//point 3
-			vertices[i + 9] = vertices[i];
-			vertices[i + 10] = WATER_HEIGHT;
-			vertices[i + 11] = vertices[i + 8];
-		}
-
-		// texture
-		for (int i = 0; i < height; i++)
-		{
-			for (int j = 0; j < width; j++)
-			{
-				//point 0
-				texture_coordinate[i * width * 8 + j * 8 + 0] = (float)(j + 1) / width;
-				texture_coordinate[i * width * 8 + j * 8 + 1] = (float)(i + 1) / height;
-				//point 1
-				texture_coordinate[i * width * 8 + j * 8 + 2] = (float)(j + 0) / width;
-				texture_coordinate[i * width * 8 + j * 8 + 3] = (float)(i + 1) / height;
-				//point 2
-				texture_coordinate[i * width * 8 + j * 8 + 4] = (float)(j + 0) / width;
-				texture_coordinate[i * width * 8 + j * 8 + 5] = (float)(i + 0) / height;
-				//point 3												 
-				texture_coordinate[i * width * 8 + j * 8 + 6] = (float)(j + 1) / width;
-				texture_coordinate[i * width * 8 + j * 8 + 7] = (float)(i + 0) / height;
-			}
-		}
-
-		// element
-		/*
-		element mesh 0
-		   2
-		 / |
-		0--1
-
-		element mesh 1
-		1--0
-		| /
-		2
-		*/
-		for (int i = 0, j = 0; i < width * height * 6; i += 6, j += 4)
-		{
-			element[i] = j + 1;
-			element[i + 1] = j;
-			element[i + 2] = j + 3;
-
-			element[i + 3] = element[i + 2];
-			element[i + 4] = j + 2;
-			element[i + 5] = element[i];
+			texture_coordinate[i * width * 8 + j * 8 + 6] = (float)(j + 1) / width;
+			texture_coordinate[i * width * 8 + j * 8 + 7] = (float)(i + 0) / depth;
 		}
+	}
 
+	// element
+	/*
+	element mesh 0
+	   2
+	 / |
+	0--1
+
+	element mesh 1
+	1--0
+	| /
+	2
+	*/
+	for (unsigned int i = 0, j = 0; i < width * depth * 6; i += 6, j += 4)
+	{
+		element[i] = j + 1;
+		element[i + 1] = j;
+		element[i + 2] = j + 3;
 
-		this->sineWater = new VAO;
-		this->sineWater->element_amount = width * height * 6;
-		glGenVertexArrays(1, &this->sineWater->vao);
-		glGenBuffers(3, this->sineWater->vbo);
-		glGenBuffers(1, &this->sineWater->ebo);
-
-		glBindVertexArray(this->sineWater->vao);
-
-		// Position attribute
-		glBindBuffer(GL_ARRAY_BUFFER, this->sineWater->vbo[0]);
-		glBufferData(GL_ARRAY_BUFFER, width * height * 4 * 3 * sizeof(GLfloat), vertices, GL_STATIC_DRAW);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
-		glEnableVertexAttribArray(0);
+		element[i + 3] = element[i + 2];
+		element[i + 4] = j + 2;
+		element[i + 5] = element[i];
+	}
+}
 
-		// Texture Coordinate attribute
-		glBindBuffer(GL_ARRAY_BUFFER, this->sineWater->vbo[1]);
-		glBufferData(GL_ARRAY_BUFFER, width * height * 4 * 2 * sizeof(GLfloat), texture_coordinate, GL_STATIC_DRAW);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
-		glEnableVertexAttribArray(1);
+//************************************************************************
+//
+// * The grid both waters are drawn with - made once, for whichever of
+//   them comes first
+//========================================================================
+void TrainView::
+initWaterGrid()
+//========================================================================
+{
+	if (this->waterGrid)
+		return;
+	GpuMemory::Owner owner("water grid");
+
+	std::vector<GLfloat> vertices;
+	std::vector<GLfloat> texture_coordinate;
+	std::vector<GLuint> element;
+	buildWaterGrid(0.01f, WATER_HEIGHT, vertices, texture_coordinate, element);
+
+	this->waterGrid = new VAO;
+	this->waterGrid->element_amount = (unsigned int)element.size();
+	glGenVertexArrays(1, &this->waterGrid->vao);
+	glGenBuffers(2, this->waterGrid->vbo);
+	glGenBuffers(1, &this->waterGrid->ebo);
+
+	glBindVertexArray(this->waterGrid->vao);
+
+	// Position attribute
+	glBindBuffer(GL_ARRAY_BUFFER, this->waterGrid->vbo[0]);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+	glEnableVertexAttribArray(0);
+
+	// Texture Coordinate attribute
+	glBindBuffer(GL_ARRAY_BUFFER, this->waterGrid->vbo[1]);
+	glBufferData(GL_ARRAY_BUFFER, texture_coordinate.size() * sizeof(GLfloat), texture_coordinate.data(),
+		GL_STATIC_DRAW);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
+	glEnableVertexAttribArray(1);
+
+	//Element attribute
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->waterGrid->ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, element.size() * sizeof(GLuint), element.data(), GL_STATIC_DRAW);
+
+	// Unbind VAO
+	glBindVertexArray(0);
+}
 
-		//Element attribute
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->sineWater->ebo);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, width * height * 6 * sizeof(GLuint), element, GL_STATIC_DRAW);
+void TrainView::
+initSineWater()
+{
+	PROFILE_ZONE("TrainView::initSineWater");
+	if (!this->sineWaterShader)
+		this->sineWaterShader = new
+		Shader(
+			PROJECT_DIR "/src/shaders/sineVS.glsl",
+			nullptr, nullptr, nullptr,
+			PROJECT_DIR "/src/shaders/sineFS.glsl");
 
-		// Unbind VAO
-		glBindVertexArray(0);
-	}
+	// the grid is the same for both waters
+	initWaterGrid();
 }
 void TrainView::
-drawSineWater()
+drawSineWater(bool depthOnly)
 {
 	glEnable(GL_BLEND);
 
 	this->sineWaterShader->Use();
+	glUniform1i(glGetUniformLocation(this->sineWaterShader->Program, "depthOnly"), depthOnly);
 
 	glm::mat4 model_matrix = glm::mat4();
 	model_matrix = glm::translate(model_matrix, this->source_pos);
@@ -1103,11 +1650,14 @@ drawSineWater()
 		&glm::vec3(0.0f, 1.0f, 0.0f)[0]);
 
 	//
-	glUniform1f(glGetUniformLocation(this->sineWaterShader->Program, ("amplitude")), tw->amplitude->value());
+	glUniform1f(glGetUniformLocation(this->sineWaterShader->Program, ("amplitude")), settings.amplitude);
 	//i
-	glUniform1f(glGetUniformLocation(this->sineWaterShader->Program, ("wavelength")), tw->waveLength->value());
+	glUniform1f(glGetUniformLocation(this->sineWaterShader->Program, ("wavelength")), settings.waveLength);
 	//ɶ
 	glUniform1f(glGetUniformLocation(this->sineWaterShader->Program, ("time")), t_time);
+	glUniformMatrix4fv(glGetUniformLocation(this->sineWaterShader->Program, "reflectionViewProjection"),
+		1, GL_FALSE, &reflectionViewProjection[0][0]);
+	setReflectionUniforms(this->sineWaterShader);
 
 	//skybox
 	glActiveTexture(GL_TEXTURE0);
@@ -1121,16 +1671,13 @@ drawSineWater()
 	glUniform1i(glGetUniformLocation(this->sineWaterShader->Program, "reflectionTexture"), 2);
 
 	 //o۾yЦm
-	GLfloat* view_matrix = new GLfloat[16];
-	glGetFloatv(GL_MODELVIEW_MATRIX, view_matrix);
-	view_matrix = inverse(view_matrix);
-	this->cameraPosition = glm::vec3(view_matrix[12], view_matrix[13], view_matrix[14]);
+	this->cameraPosition = camera.position;
 	glUniform3fv(glGetUniformLocation(this->sineWaterShader->Program, "cameraPos"), 1, &glm::vec3(cameraPosition)[0]);	
 
 	//bind VAO
-	glBindVertexArray(this->sineWater->vao);
+	glBindVertexArray(this->waterGrid->vao);
 
-	glDrawElements(GL_TRIANGLES, this->sineWater->element_amount, GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, this->waterGrid->element_amount, GL_UNSIGNED_INT, 0);
 
 	//unbind VAO
 	glBindVertexArray(0);
@@ -1140,9 +1687,43 @@ drawSineWater()
 
 	glDisable(GL_BLEND);
 }
+//************************************************************************
+//
+// * Reflection mode, the screen space reflection inputs and the refraction
+//   depth, shared by both water shaders. uses texture units 3 to 6 - the
+//   samplers are set
+//   even when unused, samplers of different types left on one unit fail
+//   the draw
+//========================================================================
+void TrainView::
+setReflectionUniforms(Shader* shader)
+//========================================================================
+{
+	glUniform1i(glGetUniformLocation(shader->Program, "reflectionMode"), reflectionMode);
+
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+	glUniform1i(glGetUniformLocation(shader->Program, "skybox"), 3);
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D, depthPyramid->colorTexture);
+	glUniform1i(glGetUniformLocation(shader->Program, "sceneColor"), 4);
+	depthPyramid->bind(5);
+	glUniform1i(glGetUniformLocation(shader->Program, "depthPyramid"), 5);
+	glUniform1i(glGetUniformLocation(shader->Program, "pyramidLevels"), depthPyramid->levels);
+
+	// depth aware shading reads the refraction depth on unit 6
+	glUniform1i(glGetUniformLocation(shader->Program, "depthShading"), depthShading);
+	this->fbos->refractionDepthTexture2D.bind(6);
+	glUniform1i(glGetUniformLocation(shader->Program, "refractionDepth"), 6);
+	glUniformMatrix4fv(glGetUniformLocation(shader->Program, "inverseProjection"), 1, GL_FALSE, &camera.inverseProjection[0][0]);
+	glActiveTexture(GL_TEXTURE0);
+}
+
 void TrainView::
 initHeightWater()
 {
+	PROFILE_ZONE("TrainView::initHeightWater");
+	GpuMemory::Owner owner("heightmaps");
 	if (!this->heightWaterShader)
 	{
 		this->heightWaterShader = new
@@ -1152,118 +1733,8 @@ initHeightWater()
 				PROJECT_DIR "/src/shaders/heightMapFS.glsl");
 	}
 
-	if (!this->heightWater) {
-
-		float size = 0.01f;
-		unsigned int width = 2.0f / size;
-		unsigned int height = 2.0f / size;
-
-		GLfloat* vertices = new GLfloat[width * height * 4 * 3]();
-		GLfloat* texture_coordinate = new GLfloat[width * height * 4 * 2]();
-		GLuint* element = new GLuint[width * height * 6]();
-
-		/*
-		 Vertices
-		*2 -- *3
-		 | \   |
-		 |  \  |
-		*1 -- *0
-		*/
-		for (int i = 0; i < width * height * 4 * 3; i += 12)
-		{
-			unsigned int h = i / 12 / width;
-			unsigned int w = i / 12 % width;
-			//point 0
-			vertices[i] = w * size - 1.0f + size;
-			vertices[i + 1] = WATER_HEIGHT;
-			vertices[i + 2] = h * size - 1.0f + size;
-			//point 1
-			vertices[i + 3] = vertices[i] - size;
-			vertices[i + 4] = WATER_HEIGHT;
-			vertices[i + 5] = vertices[i + 2];
-			//point 2
-			vertices[i + 6] = vertices[i + 3];
-			vertices[i + 7] = WATER_HEIGHT;
-			vertices[i + 8] = vertices[i + 5] - size;
-			//point 3
-			vertices[i + 9] = vertices[i];
-			vertices[i + 10] = WATER_HEIGHT;
-			vertices[i + 11] = vertices[i + 8];
-		}
-
-		// texture
-		for (int i = 0; i < height; i++)
-		{
-			for (int j = 0; j < width; j++)
-			{
-				//point 0
-				texture_coordinate[i * width * 8 + j * 8 + 0] = (float)(j + 1) / width;
-				texture_coordinate[i * width * 8 + j * 8 + 1] = (float)(i + 1) / height;
-				//point 1
-				texture_coordinate[i * width * 8 + j * 8 + 2] = (float)(j + 0) / width;
-				texture_coordinate[i * width * 8 + j * 8 + 3] = (float)(i + 1) / height;
-				//point 2
-				texture_coordinate[i * width * 8 + j * 8 + 4] = (float)(j + 0) / width;
-				texture_coordinate[i * width * 8 + j * 8 + 5] = (float)(i + 0) / height;
-				//point 3												 i
-				texture_coordinate[i * width * 8 + j * 8 + 6] = (float)(j + 1) / width;
-				texture_coordinate[i * width * 8 + j * 8 + 7] = (float)(i + 0) / height;
-			}
-		}
-
-		// element
-		/*
-		element mesh 0
-		   2
-		 / | 
-		0--1
-
-		element mesh 1
-		1--0
-		| /
-		2  
-		*/
-		for (int i = 0, j = 0; i < width * height * 6; i += 6, j += 4)
-		{
-			element[i] = j + 1;
-			element[i + 1] = j;
-			element[i + 2] = j + 3;
-
-			element[i + 3] = element[i + 2];
-			element[i + 4] = j + 2;
-			element[i + 5] = element[i];
-		}
-
-
-		this->heightWater = new VAO;
-		this->heightWater->element_amount = width * height * 6;
-		glGenVertexArrays(1, &this->heightWater->vao);
-		glGenBuffers(2, this->heightWater->vbo);
-		glGenBuffers(1, &this->heightWater->ebo);
-
-		glBindVertexArray(this->heightWater->vao);
-		glUseProgram(this->heightWaterShader->Program);
-
-		// Position attribute
-		glBindBuffer(GL_ARRAY_BUFFER, this->heightWater->vbo[0]);
-		glBufferData(GL_ARRAY_BUFFER, width * height * 4 * 3 * sizeof(GLfloat), vertices, GL_STATIC_DRAW);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
-		glEnableVertexAttribArray(0);
-
-		// Texture Coordinate attribute
-		glBindBuffer(GL_ARRAY_BUFFER, this->heightWater->vbo[1]);
-		glBufferData(GL_ARRAY_BUFFER, width * height * 4 * 2 * sizeof(GLfloat), texture_coordinate, GL_STATIC_DRAW);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
-		glEnableVertexAttribArray(1);
-
-		//Element attribute
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->heightWater->ebo);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, width * height * 6 * sizeof(GLuint), element, GL_STATIC_DRAW);
-
-		// Unbind VAO
-		glBindVertexArray(0);
-
-	}
+	// the grid is the same for both waters
+	initWaterGrid();
 
 	if (!heightTexture.size() > 0)
 	{
@@ -1282,10 +1753,11 @@ initHeightWater()
 	}
 }
 void TrainView::
-drawHeightWater()
+drawHeightWater(bool depthOnly)
 {
 	//bind shader
 	this->heightWaterShader->Use();
+	glUniform1i(glGetUniformLocation(this->heightWaterShader->Program, "depthOnly"), depthOnly);
 
 	// doing scale and transform
 	glm::mat4 model_matrix = glm::mat4();
@@ -1299,6 +1771,9 @@ drawHeightWater()
 	glUniform3fv(
 		glGetUniformLocation(this->heightWaterShader->Program, "u_color"),
 		1, &glm::vec3(0.0f, 1.0f, 0.0f)[0]);
+	glUniformMatrix4fv(glGetUniformLocation(this->heightWaterShader->Program, "reflectionViewProjection"),
+		1, GL_FALSE, &reflectionViewProjection[0][0]);
+	setReflectionUniforms(this->heightWaterShader);
 
 	//HeightMap
 	heightTexture[heightMapIndex% heightTexture.size()].bind(0);
@@ -1311,23 +1786,22 @@ drawHeightWater()
 	glUniform1i(glGetUniformLocation(this->heightWaterShader->Program, "reflectionTexture"), 2);
 
 	//o۾yЦm
-	GLfloat* view_matrix = new GLfloat[16];
-	glGetFloatv(GL_MODELVIEW_MATRIX, view_matrix);
-	view_matrix = inverse(view_matrix);
-	this->cameraPosition = glm::vec3(view_matrix[12], view_matrix[13], view_matrix[14]);
+	this->cameraPosition = camera.position;
 	glUniform3fv(glGetUniformLocation(this->heightWaterShader->Program, "cameraPos"), 1, &glm::vec3(cameraPosition)[0]);
 
 
 	//bind VAO
-	glBindVertexArray(this->heightWater->vao);
-	glDrawElements(GL_TRIANGLES, this->heightWater->element_amount, GL_UNSIGNED_INT, 0);
+	glBindVertexArray(this->waterGrid->vao);
+	glDrawElements(GL_TRIANGLES, this->waterGrid->element_amount, GL_UNSIGNED_INT, 0);
 
 	//unbind VAO
 	glBindVertexArray(0);
 
 	//unbind shader(switch to fixed pipeline)
 	glUseProgram(0);
-	heightMapIndex++;
+	// next frame's height map (the depth draw must see the same one)
+	if (!depthOnly)
+		heightMapIndex++;
 
 }
 
@@ -1336,6 +1810,7 @@ drawHeightWater()
 void TrainView::
 initMonitor()
 {
+	GpuMemory::Owner owner("monitor");
 	if (!this->monitorShader)
 		this->monitorShader = new
 		Shader(
@@ -1343,6 +1818,14 @@ initMonitor()
 			nullptr, nullptr, nullptr,
 			PROJECT_DIR "/src/shaders/monitorFS.glsl");
 
+	// the overlay draws text and graphs the same way, from a font texture
+	if (!this->hud)
+		this->hud = new Hud(new
+			Shader(
+				PROJECT_DIR "/src/shaders/hudVS.glsl",
+				nullptr, nullptr, nullptr,
+				PROJECT_DIR "/src/shaders/hudFS.glsl"));
+
 	if (!this->monitor) {
 		GLfloat  vertices[] = {
 			-1.0f, 0.0f,
@@ -1415,155 +1898,304 @@ drawMonitor(int mode)
 	//unbind shader(switch to fixed pipeline)
 	glUseProgram(0);
 }
-GLfloat* TrainView::
-inverse(GLfloat* m)
+
+// the drivers' memory queries, which not every glad has
+#ifndef GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX
+#define GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX 0x9048
+#define GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX 0x9049
+#endif
+#ifndef GL_TEXTURE_FREE_MEMORY_ATI
+#define GL_VBO_FREE_MEMORY_ATI 0x87FB
+#define GL_TEXTURE_FREE_MEMORY_ATI 0x87FC
+#endif
+
+static bool hasExtension(const char* name)
 {
-	GLfloat* inv = new GLfloat[16]();
-	float det;
-
-	int i;
-
-	inv[0] = m[5] * m[10] * m[15] -
-		m[5] * m[11] * m[14] -
-		m[9] * m[6] * m[15] +
-		m[9] * m[7] * m[14] +
-		m[13] * m[6] * m[11] -
-		m[13] * m[7] * m[10];
-
-	inv[4] = -m[4] * m[10] * m[15] +
-		m[4] * m[11] * m[14] +
-		m[8] * m[6] * m[15] -
-		m[8] * m[7] * m[14] -
-		m[12] * m[6] * m[11] +
-		m[12] * m[7] * m[10];
-
-	inv[8] = m[4] * m[9] * m[15] -
-		m[4] * m[11] * m[13] -
-		m[8] * m[5] * m[15] +
-		m[8] * m[7] * m[13] +
-		m[12] * m[5] * m[11] -
-		m[12] * m[7] * m[9];
-
-	inv[12] = -m[4] * m[9] * m[14] +
-		m[4] * m[10] * m[13] +
-		m[8] * m[5] * m[14] -
-		m[8] * m[6] * m[13] -
-		m[12] * m[5] * m[10] +
-		m[12] * m[6] * m[9];
-
-	inv[1] = -m[1] * m[10] * m[15] +
-		m[1] * m[11] * m[14] +
-		m[9] * m[2] * m[15] -
-		m[9] * m[3] * m[14] -
-		m[13] * m[2] * m[11] +
-		m[13] * m[3] * m[10];
-
-	inv[5] = m[0] * m[10] * m[15] -
-		m[0] * m[11] * m[14] -
-		m[8] * m[2] * m[15] +
-		m[8] * m[3] * m[14] +
-		m[12] * m[2] * m[11] -
-		m[12] * m[3] * m[10];
-
-	inv[9] = -m[0] * m[9] * m[15] +
-		m[0] * m[11] * m[13] +
-		m[8] * m[1] * m[15] -
-		m[8] * m[3] * m[13] -
-		m[12] * m[1] * m[11] +
-		m[12] * m[3] * m[9];
-
-	inv[13] = m[0] * m[9] * m[14] -
-		m[0] * m[10] * m[13] -
-		m[8] * m[1] * m[14] +
-		m[8] * m[2] * m[13] +
-		m[12] * m[1] * m[10] -
-		m[12] * m[2] * m[9];
-
-	inv[2] = m[1] * m[6] * m[15] -
-		m[1] * m[7] * m[14] -
-		m[5] * m[2] * m[15] +
-		m[5] * m[3] * m[14] +
-		m[13] * m[2] * m[7] -
-		m[13] * m[3] * m[6];
-
-	inv[6] = -m[0] * m[6] * m[15] +
-		m[0] * m[7] * m[14] +
-		m[4] * m[2] * m[15] -
-		m[4] * m[3] * m[14] -
-		m[12] * m[2] * m[7] +
-		m[12] * m[3] * m[6];
-
-	inv[10] = m[0] * m[5] * m[15] -
-		m[0] * m[7] * m[13] -
-		m[4] * m[1] * m[15] +
-		m[4] * m[3] * m[13] +
-		m[12] * m[1] * m[7] -
-		m[12] * m[3] * m[5];
-
-	inv[14] = -m[0] * m[5] * m[14] +
-		m[0] * m[6] * m[13] +
-		m[4] * m[1] * m[14] -
-		m[4] * m[2] * m[13] -
-		m[12] * m[1] * m[6] +
-		m[12] * m[2] * m[5];
-
-	inv[3] = -m[1] * m[6] * m[11] +
-		m[1] * m[7] * m[10] +
-		m[5] * m[2] * m[11] -
-		m[5] * m[3] * m[10] -
-		m[9] * m[2] * m[7] +
-		m[9] * m[3] * m[6];
-
-	inv[7] = m[0] * m[6] * m[11] -
-		m[0] * m[7] * m[10] -
-		m[4] * m[2] * m[11] +
-		m[4] * m[3] * m[10] +
-		m[8] * m[2] * m[7] -
-		m[8] * m[3] * m[6];
-
-	inv[11] = -m[0] * m[5] * m[11] +
-		m[0] * m[7] * m[9] +
-		m[4] * m[1] * m[11] -
-		m[4] * m[3] * m[9] -
-		m[8] * m[1] * m[7] +
-		m[8] * m[3] * m[5];
-
-	inv[15] = m[0] * m[5] * m[10] -
-		m[0] * m[6] * m[9] -
-		m[4] * m[1] * m[10] +
-		m[4] * m[2] * m[9] +
-		m[8] * m[1] * m[6] -
-		m[8] * m[2] * m[5];
-
-	det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
-
-	if (det == 0)
-		return false;
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+		if (!strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name))
+			return true;
+	return false;
+}
 
-	det = 1.0 / det;
+//========================================================================
+// The smoothed CPU time of a pass, by the name the frame graph gave it
+// (nullptr before its first frame)
+//========================================================================
+double TrainView::
+findHudPassCpu(const char* name)
+//========================================================================
+{
+	for (HudPassTime& time : hudPassCpu)
+		if (time.name == name)
+			return &time.milliseconds;
+	return nullptr;
+}
 
-	for (i = 0; i < 16; i++)
-		inv[i] = inv[i] * det;
+//************************************************************************
+//
+// * The performance overlay, in the top left corner: the frame times
+//   (the bars, against a 60 fps line), the CPU and GPU time of every pass
+//   that ran, draw calls and primitives, memory (counted by GpuMemory, and
+//   the driver's) and the sizes of the water targets. all of it is one
+//   draw (see Hud)
+//========================================================================
+void TrainView::
+drawHud()
+//========================================================================
+{
+	PROFILE_ZONE("TrainView::drawHud");
+	const unsigned int white = 0xffffffff;
+	const unsigned int gray = 0xa0a0a0ff;
+
+	hud->begin(pixel_w(), pixel_h());
+	float line = hud->lineHeight();
+	float x = 8.0f, y = 8.0f;
+	float width = 30 * hud->charWidth();
+	const std::vector<GpuProfiler::Result>& passes = gpuProfiler.getResults();
+	int rows = layeredPrepass ? 7 : 8;
+	for (const GpuProfiler::Result& pass : passes)
+		if (pass.depth == 1)
+			rows++;
+	hud->rect(x - 4, y - 4, width + 8, rows * line + 48 + 4, 0x000000a0);
+
+	// frame times
+	float frame = hudFrameTimes[hudNewest];
+	hud->print(x, y, white, "frame %5.2f ms %4.0f fps", frame, frame > 0.0f ? 1000.0f / frame : 0.0f);
+	y += line;
+	hud->print(x, y, white, "gpu   %5.2f ms", gpuProfiler.getMilliseconds("frame", true));
+	y += line;
+	const float graphMax = 33.3f;
+	hud->graph(x, y, width, 40, hudFrameTimes, HUD_HISTORY, hudNewest, graphMax, 0x40ff40ff);
+	hud->rect(x, y + 40 - 40 * 16.7f / graphMax, width, 1, 0xffff40c0);
+	y += 48;
+
+	// the passes that ran in the frame the GPU times are of
+	hud->text(x, y, "pass           cpu ms  gpu ms", gray);
+	y += line;
+	for (const GpuProfiler::Result& pass : passes) {
+		if (pass.depth != 1)
+			continue;
+		const double* cpu = findHudPassCpu(pass.name);
+		hud->print(x, y, white, "%-13.13s %7.2f %7.2f", pass.name, cpu ? *cpu : 0.0, pass.average);
+		y += line;
+	}
 
-	return inv;
+	// what was sent
+	drawStats.poll();
+	hud->print(x, y, white, "draws %u  prims %llu", drawStats.getDrawCalls(),
+		(unsigned long long)drawStats.getPrimitives());
+	y += line;
+
+	// memory, as counted (see GpuMemory)
+	size_t buffers = GpuMemory::bytes(GpuMemory::GEOMETRY) + GpuMemory::bytes(GpuMemory::UNIFORMS) +
+		GpuMemory::bytes(GpuMemory::TRANSFER) + GpuMemory::bytes(GpuMemory::OTHER_BUFFERS);
+	hud->print(x, y, white, "tex %.1f  rt %.1f  buf %.1f mb", GpuMemory::bytes(GpuMemory::TEXTURES) / 1048576.0,
+		GpuMemory::bytes(GpuMemory::RENDER_TARGETS) / 1048576.0, buffers / 1048576.0);
+	y += line;
+
+	// and from the driver, if it says. those queries can wait for the
+	// driver, so only every HUD_MEMORY_FRAMES frames
+	static const bool nvidia = hasExtension("GL_NVX_gpu_memory_info");
+	static const bool ati = hasExtension("GL_ATI_meminfo");
+	if ((nvidia || ati) && ++hudMemoryAge >= HUD_MEMORY_FRAMES) {
+		hudMemoryAge = 0;
+		GLint kilobytes[4] = { 0, 0, 0, 0 };
+		if (nvidia) {
+			glGetIntegerv(GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &hudMemory[0]);
+			glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, kilobytes);
+			hudMemory[1] = kilobytes[0];
+		}
+		else {
+			glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, kilobytes);
+			hudMemory[0] = kilobytes[0];
+			glGetIntegerv(GL_VBO_FREE_MEMORY_ATI, kilobytes);
+			hudMemory[1] = kilobytes[0];
+		}
+	}
+	if (nvidia)
+		hud->print(x, y, white, "vram  %d / %d mb", (hudMemory[0] - hudMemory[1]) / 1024, hudMemory[0] / 1024);
+	else if (ati)
+		hud->print(x, y, white, "free  tex %d mb  buf %d mb", hudMemory[0] / 1024, hudMemory[1] / 1024);
+	else
+		hud->text(x, y, "vram  n/a", gray);
+	y += line;
+
+	// the water targets
+	if (layeredPrepass)
+		hud->print(x, y, white, "layers     %4ux%-4u %3.0f%%", fbos->LAYERED_WIDTH, fbos->LAYERED_HEIGHT,
+			100.0f * fbos->layeredScale);
+	else {
+		hud->print(x, y, white, "reflection %4ux%-4u %3.0f%%", fbos->REFLECTION_WIDTH, fbos->REFLECTION_HEIGHT,
+			100.0f * fbos->reflectionScale);
+		y += line;
+		hud->print(x, y, white, "refraction %4ux%-4u %3.0f%%", fbos->REFRACTION_WIDTH, fbos->REFRACTION_HEIGHT,
+			100.0f * fbos->refractionScale);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+	glDisable(GL_CLIP_DISTANCE0);
+	hud->end();
+}
+
+//************************************************************************
+//
+// * The water of the selected wave mode. with waterDepthPrepass its depth
+//   goes in first and the shading draw only passes where it is equal, so
+//   the heavy water shader runs once per pixel however many waves overlap
+//========================================================================
+void TrainView::
+drawWater()
+//========================================================================
+{
+	int wave = settings.wave;
+	if (wave != 1 && wave != 2)
+		return;
+
+	if (waterDepthPrepass) {
+		GpuProfiler::Scope scope(gpuProfiler, "water depth");
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		if (wave == 1)
+			drawSineWater(true);
+		else
+			drawHeightWater(true);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+	}
+
+	{
+		GpuProfiler::Scope scope(gpuProfiler, "water shading");
+		if (wave == 1)
+			drawSineWater();
+		else
+			drawHeightWater();
+	}
+
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
 }
 
 void TrainView::
 renderScene(int mode =0)
 {
-	// draw skybox
-	drawSkybox();
-	// start draw water
-	drawTiles(mode);
+	// the reflection pass looks at the world mirrored about the water. the
+	// layered pass draws both, it is sorted for the reflection
+	bool reflected = mode == 1 || mode == 3;
+	const glm::mat4& view_matrix = reflected ? camera.reflectedView : camera.view;
+	if (mode == 3)
+		setLayeredUBO();	// both views come from the layered UBO
+	else
+		setUBO(view_matrix);
+
+	drawList.begin(view_matrix);
+
+	// the sphere is always drawn through the reflected view - seen from
+	// the camera itself (mode 0) it is mirrored about the water
+	if (mode != 2) {
+		glm::vec3 center(0.0f);
+		if (!reflected)
+			center.y = 2.0f * (this->source_pos.y + WATER_HEIGHT * 100.0f);
+		drawList.add(DrawList::BUCKET_OPAQUE, center - glm::vec3(25.0f), center + glm::vec3(25.0f),
+			[](void* context, int) {
+				TrainView* view = (TrainView*)context;
+				GpuProfiler::Scope scope(view->gpuProfiler, "sphere");
+				view->drawSphere(view->camera.reflectedView);
+			}, this);
+	}
+
+	// seen in the reflection the tiles are translucent (tiles.frag writes
+	// alpha 0.5 in clip mode 1 and layer 0 of mode 3): they blend over the
+	// sky, so they have to come after it
+	drawList.add(reflected ? DrawList::BUCKET_BLENDED : DrawList::BUCKET_OPAQUE,
+		this->source_pos - glm::vec3(100.0f), this->source_pos + glm::vec3(100.0f),
+		[](void* context, int mode) {
+			TrainView* view = (TrainView*)context;
+			GpuProfiler::Scope scope(view->gpuProfiler, "tiles");
+			view->drawTiles(mode);
+		}, this, mode);
+
+	// skybox after the opaque draws, it only fills what is left
+	drawList.add(DrawList::BUCKET_SKY, [](void* context, int mode) {
+		TrainView* view = (TrainView*)context;
+		GpuProfiler::Scope scope(view->gpuProfiler, "skybox");
+		if (mode == 3)
+			view->drawSkyboxLayered();
+		else
+			view->drawSkybox(mode == 1 ? view->camera.reflectedView : view->camera.view);
+	}, this, mode);
+
+	drawList.draw();
+}
+
+void TrainView::
+drawSphere(const glm::mat4& view_matrix)
+{
+	markers->draw(InstancedMarkers::SPHERE, camera.projection * view_matrix);
+}
+
+//************************************************************************
+//
+// * The instanced markers: the control points and the debug sphere
+//========================================================================
+void TrainView::
+initMarkers()
+//========================================================================
+{
+	GpuMemory::Owner owner("markers");
+	if (this->markers)
+		return;
+	this->markers = new InstancedMarkers(
+		new Shader(PROJECT_DIR "/src/shaders/markerVS.glsl",
+			nullptr, nullptr, nullptr,
+			PROJECT_DIR "/src/shaders/markerFS.glsl"),
+		new Shader(PROJECT_DIR "/src/shaders/markerVS.glsl",
+			nullptr, nullptr, nullptr,
+			PROJECT_DIR "/src/shaders/markerIdFS.glsl"));
+
+	// the sphere never moves, its instance is set once
+	std::vector<InstancedMarkers::Instance> sphere(1);
+	sphere[0].model = glm::scale(glm::mat4(), glm::vec3(25.0f));
+	sphere[0].color = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+	this->markers->setInstances(InstancedMarkers::SPHERE, sphere);
 }
 
+//************************************************************************
+//
+// * Upload the control point instances again, only if a point or the
+//   selection changed since the last upload. comparing the points is far
+//   cheaper than sending them
+//========================================================================
 void TrainView::
-drawSphere()
+updateControlPointMarkers()
+//========================================================================
 {
-	glColor3f(1, 0, 0);
-	GLUquadric* quad;
-	quad = gluNewQuadric();
-	glTranslatef(0, 0, 0);
-	gluSphere(quad, 25, 100, 20);
+	const std::vector<ControlPoint>& points = m_pTrack->points;
+	bool changed = points.size() != markerPoints.size() || selectedCube != markerSelected;
+	for (size_t i = 0; i < points.size() && !changed; ++i) {
+		const ControlPoint& a = points[i];
+		const ControlPoint& b = markerPoints[i];
+		changed = a.pos.x != b.pos.x || a.pos.y != b.pos.y || a.pos.z != b.pos.z ||
+			a.orient.x != b.orient.x || a.orient.y != b.orient.y || a.orient.z != b.orient.z;
+	}
+	if (!changed)
+		return;
+	markerPoints = points;
+	markerSelected = selectedCube;
+
+	// the transform ControlPoint::draw builds with glRotatef
+	std::vector<InstancedMarkers::Instance> instances(points.size());
+	for (size_t i = 0; i < points.size(); ++i) {
+		const ControlPoint& point = points[i];
+		glm::mat4 model = glm::translate(glm::mat4(), glm::vec3(point.pos.x, point.pos.y, point.pos.z));
+		model = glm::rotate(model, -atan2f(point.orient.z, point.orient.x), glm::vec3(0.0f, 1.0f, 0.0f));
+		model = glm::rotate(model, -acosf(point.orient.y), glm::vec3(0.0f, 0.0f, 1.0f));
+		instances[i].model = model;
+		instances[i].color = ((int)i != selectedCube) ?
+			glm::vec4(240.0f, 60.0f, 60.0f, 255.0f) / 255.0f :
+			glm::vec4(240.0f, 240.0f, 30.0f, 255.0f) / 255.0f;
+	}
+	markers->setInstances(InstancedMarkers::CONTROL_POINT, instances);
 }
 
@@ -25,8 +25,8 @@
 
 *************************************************************************/
 
-#include <FL/fl.h>
-#include <FL/Fl_Box.h>
+#include <FL/Fl.H>
+#include <FL/Fl_Box.H>
 
 // for using the real time clock
 #include <time.h>
@@ -34,6 +34,7 @@
 #include "TrainWindow.H"
 #include "TrainView.H"
 #include "CallBacks.H"
+#include "RenderUtilities/CpuProfiler.h"
 
 
 
@@ -222,6 +223,7 @@ void TrainWindow::
 advanceTrain(float dir)
 //========================================================================
 {
+	PROFILE_ZONE("TrainWindow::advanceTrain");
 
 
 
@@ -30,12 +30,14 @@
 
 #include <math.h>
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <GL/gl.h>
-#include <FL/Fl.h>
+#include <FL/Fl.H>
 #include <GL/glu.h>
 
-#include "3DUtils.H"
+#include "3DUtils.h"
 
 #include <vector>
 using std::vector;
@@ -52,19 +52,23 @@
 #include "ArcBallCam.H"
 
 #include <math.h>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 // the FlTk headers have lots of warnings - these are bad, but there's not
 // much we can do about them
 #pragma warning(push)
 #pragma warning(disable:4311)		// convert void* to long
 #pragma warning(disable:4312)		// convert long to void*
-#include <FL/Fl_Gl_Window.h>
-#include <Fl/Fl.h>
+#include <FL/Fl_Gl_Window.H>
+#include <FL/Fl.H>
 #include <GL/gl.h>
 #include <GL/glu.h>
-#include <Fl/Fl_Double_Window.h>
+#include <FL/Fl_Double_Window.H>
 #pragma warning(pop)
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include<iostream>
 #include "stdio.h"
 
@@ -121,20 +125,36 @@ setProjection(bool doClear)
 //==========================================================================
 {
   //std::cout << "setProjection" << "\n";
+  // Compute the aspect ratio so we don't distort things
+  float aspect = ((float) wind->w()) / ((float) wind->h());
+
+  glm::mat4 view, projection;
+  getMatrices(aspect, view, projection);
+
   glMatrixMode(GL_PROJECTION);
   if (doClear)
 	  glLoadIdentity();
-
-  // Compute the aspect ratio so we don't distort things
-  double aspect = ((double) wind->w()) / ((double) wind->h());
-  gluPerspective(fieldOfView, aspect, .1, 1000);
+  glMultMatrixf(&projection[0][0]);
 
   // Put the camera where we want it to be
   glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();
-  // Use the transformation in the ArcBall
-  glTranslatef(-eyeX, -eyeY, -eyeZ);
-  multMatrix();
+  glLoadMatrixf(&view[0][0]);
+}
+
+//**************************************************************************
+//
+// * Build the view and projection matrices without touching GL
+//==========================================================================
+void ArcBallCam::
+getMatrices(float aspect, glm::mat4& view, glm::mat4& projection) const
+//==========================================================================
+{
+	projection = glm::perspective(glm::radians(fieldOfView), aspect, .1f, 1000.0f);
+
+	// Use the transformation in the ArcBall
+	HMatrix m;
+	getMatrix(m);
+	view = glm::translate(glm::vec3(-eyeX, -eyeY, -eyeZ)) * glm::make_mat4((float*) m);
 }
 
 //**************************************************************************
@@ -298,6 +318,34 @@ reset()
 	now.x = now.y = now.z = 0; now.w = 1;
 }
 
+//**************************************************************************
+//
+// * Write the pose as one line: eyeX eyeY eyeZ and the quaternion
+//==========================================================================
+void ArcBallCam::
+writePose(FILE* file) const
+//==========================================================================
+{
+	Quat q = now * start;
+	fprintf(file, "%g %g %g %g %g %g %g\n", eyeX, eyeY, eyeZ, q.x, q.y, q.z, q.w);
+}
+
+//**************************************************************************
+//
+// * Read a line of writePose back
+//==========================================================================
+bool ArcBallCam::
+readPose(FILE* file)
+//==========================================================================
+{
+	Quat q;
+	if (fscanf(file, "%f %f %f %f %f %f %f", &eyeX, &eyeY, &eyeZ, &q.x, &q.y, &q.z, &q.w) != 7)
+		return false;
+	start = q;
+	now = Quat();
+	return true;
+}
+
 //**************************************************************************
 //
 // * 
@@ -0,0 +1,324 @@
+/************************************************************************
+     File:        MatrixUtils.cpp
+
+     Comment:
+						Small 4x4 matrix routines for the render loop.
+						See MatrixUtils.H
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include "MatrixUtils.H"
+
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define MATRIX_UTILS_SSE 1
+#	include <emmintrin.h>		// SSE2, invertAffine builds a mask from integers
+#endif
+
+#ifdef MATRIX_UTILS_SSE
+
+// shuffle helpers - the masks pick (x, y, z, w) lanes, first two from a,
+// last two from b
+#define SHUFFLE_MASK(x, y, z, w)	((x) | ((y) << 2) | ((z) << 4) | ((w) << 6))
+#define SWIZZLE(v, x, y, z, w)		_mm_shuffle_ps(v, v, SHUFFLE_MASK(x, y, z, w))
+#define SHUFFLE(a, b, x, y, z, w)	_mm_shuffle_ps(a, b, SHUFFLE_MASK(x, y, z, w))
+
+//*************************************************************************
+//
+// The general inverse works on the four 2x2 blocks of the matrix
+//		| A B |
+//		| C D |
+// each block lives in one register as (m00, m01, m10, m11).
+//
+// 2x2 product A * B
+//=========================================================================
+static inline __m128 mat2Mul(__m128 a, __m128 b)
+//=========================================================================
+{
+	return _mm_add_ps(_mm_mul_ps(a, SWIZZLE(b, 0, 3, 0, 3)),
+		_mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+//*************************************************************************
+//
+// 2x2 adjugate(A) * B
+//=========================================================================
+static inline __m128 mat2AdjMul(__m128 a, __m128 b)
+//=========================================================================
+{
+	return _mm_sub_ps(_mm_mul_ps(SWIZZLE(a, 3, 3, 0, 0), b),
+		_mm_mul_ps(SWIZZLE(a, 1, 1, 2, 2), SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+//*************************************************************************
+//
+// 2x2 A * adjugate(B)
+//=========================================================================
+static inline __m128 mat2MulAdj(__m128 a, __m128 b)
+//=========================================================================
+{
+	return _mm_sub_ps(_mm_mul_ps(a, SWIZZLE(b, 3, 0, 3, 0)),
+		_mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+//*************************************************************************
+//
+// a x b for the xyz lanes (w ends up 0 when both w are 0)
+//=========================================================================
+static inline __m128 cross3(__m128 a, __m128 b)
+//=========================================================================
+{
+	__m128 r = _mm_sub_ps(_mm_mul_ps(a, SWIZZLE(b, 1, 2, 0, 3)),
+		_mm_mul_ps(SWIZZLE(a, 1, 2, 0, 3), b));
+	return SWIZZLE(r, 1, 2, 0, 3);
+}
+
+//*************************************************************************
+//
+// sum of the xyz lanes, splatted
+//=========================================================================
+static inline __m128 dot3(__m128 a, __m128 b)
+//=========================================================================
+{
+	__m128 p = _mm_mul_ps(a, b);
+	return _mm_add_ps(_mm_add_ps(SWIZZLE(p, 0, 0, 0, 0), SWIZZLE(p, 1, 1, 1, 1)),
+		SWIZZLE(p, 2, 2, 2, 2));
+}
+
+#endif // MATRIX_UTILS_SSE
+
+//*************************************************************************
+//
+// * General 4x4 inverse
+//=========================================================================
+bool invertMatrix(const float* m, float* out)
+//=========================================================================
+{
+#ifdef MATRIX_UTILS_SSE
+	__m128 c0 = _mm_loadu_ps(m);
+	__m128 c1 = _mm_loadu_ps(m + 4);
+	__m128 c2 = _mm_loadu_ps(m + 8);
+	__m128 c3 = _mm_loadu_ps(m + 12);
+
+	// the 2x2 blocks
+	__m128 A = _mm_movelh_ps(c0, c1);
+	__m128 B = _mm_movehl_ps(c1, c0);
+	__m128 C = _mm_movelh_ps(c2, c3);
+	__m128 D = _mm_movehl_ps(c3, c2);
+
+	// (|A| |B| |C| |D|)
+	__m128 detSub = _mm_sub_ps(
+		_mm_mul_ps(SHUFFLE(c0, c2, 0, 2, 0, 2), SHUFFLE(c1, c3, 1, 3, 1, 3)),
+		_mm_mul_ps(SHUFFLE(c0, c2, 1, 3, 1, 3), SHUFFLE(c1, c3, 0, 2, 0, 2)));
+	__m128 detA = SWIZZLE(detSub, 0, 0, 0, 0);
+	__m128 detB = SWIZZLE(detSub, 1, 1, 1, 1);
+	__m128 detC = SWIZZLE(detSub, 2, 2, 2, 2);
+	__m128 detD = SWIZZLE(detSub, 3, 3, 3, 3);
+
+	__m128 D_C = mat2AdjMul(D, C);
+	__m128 A_B = mat2AdjMul(A, B);
+
+	// adjugates of the blocks of the inverse
+	__m128 X_ = _mm_sub_ps(_mm_mul_ps(detD, A), mat2Mul(B, D_C));
+	__m128 W_ = _mm_sub_ps(_mm_mul_ps(detA, D), mat2Mul(C, A_B));
+	__m128 Y_ = _mm_sub_ps(_mm_mul_ps(detB, C), mat2MulAdj(D, A_B));
+	__m128 Z_ = _mm_sub_ps(_mm_mul_ps(detC, B), mat2MulAdj(A, D_C));
+
+	// |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+	__m128 tr = _mm_mul_ps(A_B, SWIZZLE(D_C, 0, 2, 1, 3));
+	tr = _mm_add_ps(tr, SWIZZLE(tr, 2, 3, 0, 1));
+	tr = _mm_add_ps(tr, SWIZZLE(tr, 1, 0, 3, 2));
+	__m128 detM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+
+	if (_mm_cvtss_f32(detM) == 0.0f)
+		return false;
+
+	__m128 rDetM = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), detM);
+	X_ = _mm_mul_ps(X_, rDetM);
+	Y_ = _mm_mul_ps(Y_, rDetM);
+	Z_ = _mm_mul_ps(Z_, rDetM);
+	W_ = _mm_mul_ps(W_, rDetM);
+
+	// undo the adjugate and put the blocks back into columns
+	_mm_storeu_ps(out,      SHUFFLE(X_, Y_, 3, 1, 3, 1));
+	_mm_storeu_ps(out + 4,  SHUFFLE(X_, Y_, 2, 0, 2, 0));
+	_mm_storeu_ps(out + 8,  SHUFFLE(Z_, W_, 3, 1, 3, 1));
+	_mm_storeu_ps(out + 12, SHUFFLE(Z_, W_, 2, 0, 2, 0));
+	return true;
+#else
+	float inv[16];
+
+	inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] +
+		m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+	inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] -
+		m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+	inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] +
+		m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+	inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] -
+		m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+	inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] -
+		m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+	inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] +
+		m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+	inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] -
+		m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+	inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] +
+		m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+	inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] +
+		m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+	inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] -
+		m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+	inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] +
+		m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+	inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] -
+		m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+	inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] -
+		m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+	inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] +
+		m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+	inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] -
+		m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+	inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] +
+		m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+	float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+	if (det == 0)
+		return false;
+
+	det = 1.0f / det;
+	for (int i = 0; i < 16; i++)
+		out[i] = inv[i] * det;
+	return true;
+#endif
+}
+
+//*************************************************************************
+//
+// * Affine inverse: | R t |^-1  =  | R^-1  -R^-1 t |
+//                   | 0 1 |        |  0       1    |
+//=========================================================================
+bool invertAffine(const float* m, float* out)
+//=========================================================================
+{
+#ifdef MATRIX_UTILS_SSE
+	// keep only xyz of the columns
+	const __m128 xyzMask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	__m128 c0 = _mm_and_ps(_mm_loadu_ps(m), xyzMask);
+	__m128 c1 = _mm_and_ps(_mm_loadu_ps(m + 4), xyzMask);
+	__m128 c2 = _mm_and_ps(_mm_loadu_ps(m + 8), xyzMask);
+	__m128 t  = _mm_loadu_ps(m + 12);
+
+	// rows of R^-1 are the cross products of the columns over the determinant
+	__m128 r0 = cross3(c1, c2);
+	__m128 r1 = cross3(c2, c0);
+	__m128 r2 = cross3(c0, c1);
+	__m128 det = dot3(c0, r0);
+	if (_mm_cvtss_f32(det) == 0.0f)
+		return false;
+
+	__m128 rDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+	r0 = _mm_mul_ps(r0, rDet);
+	r1 = _mm_mul_ps(r1, rDet);
+	r2 = _mm_mul_ps(r2, rDet);
+
+	// rows -> columns
+	__m128 r3 = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+	// -R^-1 t, with w = 1
+	__m128 nt = _mm_add_ps(_mm_add_ps(
+		_mm_mul_ps(r0, SWIZZLE(t, 0, 0, 0, 0)),
+		_mm_mul_ps(r1, SWIZZLE(t, 1, 1, 1, 1))),
+		_mm_mul_ps(r2, SWIZZLE(t, 2, 2, 2, 2)));
+	nt = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), nt);
+
+	_mm_storeu_ps(out, r0);
+	_mm_storeu_ps(out + 4, r1);
+	_mm_storeu_ps(out + 8, r2);
+	_mm_storeu_ps(out + 12, nt);
+	return true;
+#else
+	float r[9];
+	r[0] = m[5] * m[10] - m[9] * m[6];
+	r[1] = m[9] * m[2] - m[1] * m[10];
+	r[2] = m[1] * m[6] - m[5] * m[2];
+	r[3] = m[8] * m[6] - m[4] * m[10];
+	r[4] = m[0] * m[10] - m[8] * m[2];
+	r[5] = m[4] * m[2] - m[0] * m[6];
+	r[6] = m[4] * m[9] - m[8] * m[5];
+	r[7] = m[8] * m[1] - m[0] * m[9];
+	r[8] = m[0] * m[5] - m[4] * m[1];
+
+	float det = m[0] * r[0] + m[4] * r[1] + m[8] * r[2];
+	if (det == 0)
+		return false;
+	det = 1.0f / det;
+
+	float tx = m[12], ty = m[13], tz = m[14];
+	for (int c = 0; c < 3; c++) {
+		out[c * 4 + 0] = r[c * 3 + 0] * det;
+		out[c * 4 + 1] = r[c * 3 + 1] * det;
+		out[c * 4 + 2] = r[c * 3 + 2] * det;
+		out[c * 4 + 3] = 0.0f;
+	}
+	out[12] = -(out[0] * tx + out[4] * ty + out[8] * tz);
+	out[13] = -(out[1] * tx + out[5] * ty + out[9] * tz);
+	out[14] = -(out[2] * tx + out[6] * ty + out[10] * tz);
+	out[15] = 1.0f;
+	return true;
+#endif
+}
+
+//*************************************************************************
+//
+// * out = a * b
+//=========================================================================
+void multMatrix(const float* a, const float* b, float* out)
+//=========================================================================
+{
+#ifdef MATRIX_UTILS_SSE
+	__m128 a0 = _mm_loadu_ps(a);
+	__m128 a1 = _mm_loadu_ps(a + 4);
+	__m128 a2 = _mm_loadu_ps(a + 8);
+	__m128 a3 = _mm_loadu_ps(a + 12);
+
+	__m128 r[4];
+	for (int i = 0; i < 4; i++) {
+		__m128 bc = _mm_loadu_ps(b + i * 4);
+		r[i] = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(a0, SWIZZLE(bc, 0, 0, 0, 0)), _mm_mul_ps(a1, SWIZZLE(bc, 1, 1, 1, 1))),
+			_mm_add_ps(_mm_mul_ps(a2, SWIZZLE(bc, 2, 2, 2, 2)), _mm_mul_ps(a3, SWIZZLE(bc, 3, 3, 3, 3))));
+	}
+	for (int i = 0; i < 4; i++)
+		_mm_storeu_ps(out + i * 4, r[i]);
+#else
+	float r[16];
+	for (int c = 0; c < 4; c++)
+		for (int row = 0; row < 4; row++)
+			r[c * 4 + row] = a[row] * b[c * 4] + a[4 + row] * b[c * 4 + 1] +
+				a[8 + row] * b[c * 4 + 2] + a[12 + row] * b[c * 4 + 3];
+	for (int i = 0; i < 16; i++)
+		out[i] = r[i];
+#endif
+}
+
+//*************************************************************************
+//
+// * The eye sits at the origin of view space, so its world position is
+//   the translation of the inverse view
+//=========================================================================
+void extractCameraPos(const float* view, float* pos)
+//=========================================================================
+{
+	float inv[16];
+	if (!invertAffine(view, inv)) {
+		pos[0] = pos[1] = pos[2] = 0.0f;
+		return;
+	}
+	pos[0] = inv[12];
+	pos[1] = inv[13];
+	pos[2] = inv[14];
+}
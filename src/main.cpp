@@ -23,21 +23,58 @@
 *************************************************************************/
 
 #include "stdio.h"
+#include <string.h>
 #include "TrainWindow.H"
+#include "TrainView.H"
+#include "InputRecording.H"
+#include "RenderUtilities/CpuProfiler.h"
+#include "RenderUtilities/GpuMemory.h"
+#ifdef WATER_HEADLESS
+#include "Headless.H"
+#endif
 
 #pragma warning(push)
 #pragma warning(disable:4312)
 #pragma warning(disable:4311)
-#include <Fl/Fl.h>
+#include <FL/Fl.H>
 #pragma warning(pop)
 
 
-int main(int, char**)
+int main(int argc, char** argv)
  {
+	PROFILE_THREAD("main");
+
+#ifdef WATER_HEADLESS
+	// no window: draw offscreen (see Headless.H)
+	if (isHeadless(argc, argv)) {
+		HeadlessOptions options;
+		if (!parseHeadlessOptions(argc, argv, options))
+			return 1;
+		int result = runHeadless(options);
+		PROFILE_WRITE("trace.json");
+		return result;
+	}
+#endif
+
 	printf("CS559 Train Assignment\n");
 
 	TrainWindow tw;
+
+	// --record input.rec writes down what the view gets from the mouse,
+	// the keyboard and the widgets, --replay input.rec plays it back
+	// (InputRecording.H)
+	InputRecorder recorder;
+	InputReplay replay;
+	for (int i = 1; i + 1 < argc; i++) {
+		if (!strcmp(argv[i], "--record") && recorder.open(argv[++i]))
+			tw.trainView->inputRecorder = &recorder;
+		else if (!strcmp(argv[i], "--replay") && replay.open(argv[++i]))
+			tw.trainView->inputReplay = &replay;
+	}
+
 	tw.show();
 
 	Fl::run();
+	PROFILE_WRITE("trace.json");
+	GpuMemory::report(stderr);
 }
\ No newline at end of file
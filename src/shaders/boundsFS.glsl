@@ -0,0 +1,8 @@
+#version 430 core
+out vec4 f_color;
+
+// only drawn for occlusion queries, color writes are off
+void main()
+{
+    f_color = vec4(1.0);
+}
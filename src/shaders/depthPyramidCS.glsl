@@ -0,0 +1,98 @@
+#version 430 core
+
+// Builds up to 5 levels of the min/max depth pyramid in one dispatch.
+//
+// Every thread reduces a 2x2 block of the source level into one texel of
+// the first output level, then the workgroup keeps halving its tile in
+// shared memory: 16x16 -> 8x8 -> 4x4 -> 2x2 -> 1x1. The first level handles
+// odd sizes itself, after that the CPU side only asks for as many levels as
+// have even sizes, so a tile never needs texels of its neighbours.
+layout (local_size_x = 16, local_size_y = 16) in;
+
+// u_copy: the source is a depth texture, and the texels read are also
+// written to level 0 of the pyramid
+uniform sampler2D u_source;
+uniform bool u_copy;
+uniform ivec2 u_sourceSize;
+uniform int u_levels;
+
+layout (rg32f, binding = 0) uniform writeonly image2D u_level0;
+layout (rg32f, binding = 1) uniform writeonly image2D u_out[5];
+
+// min in r, max in g
+shared vec2 s_tile[16][16];
+
+vec2 load(ivec2 texel)
+{
+    texel = min(texel, u_sourceSize - 1);
+    if (u_copy)
+    {
+        float depth = texelFetch(u_source, texel, 0).r;
+        return vec2(depth);
+    }
+    return texelFetch(u_source, texel, 0).rg;
+}
+
+vec2 reduce(vec2 a, vec2 b, vec2 c, vec2 d)
+{
+    return vec2(min(min(a.x, b.x), min(c.x, d.x)), max(max(a.y, b.y), max(c.y, d.y)));
+}
+
+void main()
+{
+    ivec2 local = ivec2(gl_LocalInvocationID.xy);
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    // mip sizes never go below 1
+    ivec2 size = max(u_sourceSize / 2, ivec2(1));
+
+    ivec2 source = texel * 2;
+    vec2 a = load(source);
+    vec2 b = load(source + ivec2(1, 0));
+    vec2 c = load(source + ivec2(0, 1));
+    vec2 d = load(source + ivec2(1, 1));
+
+    if (u_copy)
+    {
+        if (all(lessThan(source, u_sourceSize)))                  imageStore(u_level0, source, vec4(a, 0.0, 0.0));
+        if (all(lessThan(source + ivec2(1, 0), u_sourceSize)))    imageStore(u_level0, source + ivec2(1, 0), vec4(b, 0.0, 0.0));
+        if (all(lessThan(source + ivec2(0, 1), u_sourceSize)))    imageStore(u_level0, source + ivec2(0, 1), vec4(c, 0.0, 0.0));
+        if (all(lessThan(source + ivec2(1, 1), u_sourceSize)))    imageStore(u_level0, source + ivec2(1, 1), vec4(d, 0.0, 0.0));
+    }
+
+    // an odd source has one texel more than 2x the output covers - the
+    // last output texel takes it in, so nothing is lost
+    vec2 value = reduce(a, b, c, d);
+    bool lastX = texel.x == size.x - 1 && (u_sourceSize.x & 1) == 1;
+    bool lastY = texel.y == size.y - 1 && (u_sourceSize.y & 1) == 1;
+    if (lastX)
+        value = reduce(value, load(source + ivec2(2, 0)), load(source + ivec2(2, 1)), value);
+    if (lastY)
+        value = reduce(value, load(source + ivec2(0, 2)), load(source + ivec2(1, 2)), value);
+    if (lastX && lastY)
+        value = reduce(value, load(source + ivec2(2, 2)), value, value);
+
+    if (u_levels > 0 && all(lessThan(texel, size)))
+        imageStore(u_out[0], texel, vec4(value, 0.0, 0.0));
+    s_tile[local.y][local.x] = value;
+
+    int tile = 16;
+    for (int level = 1; level < u_levels; level++)
+    {
+        barrier();
+        tile /= 2;
+        size = max(size / 2, ivec2(1));
+        bool active = all(lessThan(local, ivec2(tile)));
+        if (active)
+        {
+            ivec2 s = local * 2;
+            value = reduce(s_tile[s.y][s.x], s_tile[s.y][s.x + 1], s_tile[s.y + 1][s.x], s_tile[s.y + 1][s.x + 1]);
+            texel = ivec2(gl_WorkGroupID.xy) * tile + local;
+            if (all(lessThan(texel, size)))
+                imageStore(u_out[level], texel, vec4(value, 0.0, 0.0));
+        }
+        // everyone has read the old tile before it is overwritten
+        barrier();
+        if (active)
+            s_tile[local.y][local.x] = value;
+    }
+}
@@ -6,6 +6,9 @@ layout (location = 2) in vec3 normal;
 uniform mat4 u_model;
 uniform sampler2D u_height;
 
+// view-projection the reflection texture was last rendered with
+uniform mat4 reflectionViewProjection;
+
 const float WAVE_MAX_HEIGHT = 0.5f;
 
 
@@ -21,6 +24,7 @@ out V_OUT
    vec3 normal;
    vec2 texture_coordinate;
    vec4 clipSpace;
+   vec4 reflectionClipSpace;
 } v_out;
 
 void main()
@@ -35,6 +39,7 @@ void main()
     v_out.position = vec3(position+vec3(0.0f, color.x*WAVE_MAX_HEIGHT-WAVE_MAX_HEIGHT/2.0f, 0.0f));
     v_out.clipSpace =  u_projection * u_view * u_model * vec4(position+vec3(0.0f, color.x*WAVE_MAX_HEIGHT-WAVE_MAX_HEIGHT/2.0f, 0.0f), 1.0f);
     //]wgOǶFA]rgbO@˪ȡA@YiC
+    v_out.reflectionClipSpace = reflectionViewProjection * u_model * vec4(v_out.position, 1.0f);
     gl_Position = v_out.clipSpace;
 
 }
\ No newline at end of file
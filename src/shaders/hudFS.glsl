@@ -0,0 +1,16 @@
+#version 430 core
+out vec4 f_color;
+
+in V_OUT
+{
+   vec2 texture_coordinate;
+   vec4 color;
+} f_in;
+
+// white, the font in alpha (see Hud.h)
+uniform sampler2D u_font;
+
+void main()
+{
+    f_color = f_in.color * texture(u_font, f_in.texture_coordinate);
+}
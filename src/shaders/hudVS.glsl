@@ -0,0 +1,21 @@
+#version 430 core
+layout (location = 0) in vec2 position;
+layout (location = 1) in vec2 texture_coordinate;
+layout (location = 2) in vec4 color;
+
+out V_OUT
+{
+   vec2 texture_coordinate;
+   vec4 color;
+} v_out;
+
+// the window, in pixels. positions are pixels down from the top left
+uniform vec2 u_size;
+
+void main()
+{
+    vec2 ndc = position / u_size * 2.0f - 1.0f;
+    gl_Position = vec4(ndc.x, -ndc.y, 0.0f, 1.0f);
+    v_out.texture_coordinate = texture_coordinate;
+    v_out.color = color;
+}
@@ -0,0 +1,28 @@
+#version 430 core
+out vec4 f_color;
+
+in V_OUT
+{
+   vec3 normal;
+   vec4 color;
+   flat int instance;
+} f_in;
+
+uniform bool u_shadow;
+
+// the main light of the fixed pipeline scene (GL_LIGHT0)
+const vec3 LIGHT_DIRECTION = vec3(0.0f, 0.70710678f, 0.70710678f);
+const float AMBIENT = 0.3f;
+
+void main()
+{
+    // the squished shadows are transparent black
+    if (u_shadow)
+    {
+        f_color = vec4(0.0f, 0.0f, 0.0f, 0.5f);
+        return;
+    }
+
+    float diffuse = max(dot(normalize(f_in.normal), LIGHT_DIRECTION), 0.0f);
+    f_color = vec4(f_in.color.rgb * min(AMBIENT + diffuse, 1.0f), f_in.color.a);
+}
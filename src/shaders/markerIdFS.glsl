@@ -0,0 +1,17 @@
+#version 430 core
+// the id of the instance, for picking (see PickBuffer)
+layout (location = 0) out uint f_id;
+
+in V_OUT
+{
+   vec3 normal;
+   vec4 color;
+   flat int instance;
+} f_in;
+
+uniform uint u_first_id;
+
+void main()
+{
+    f_id = u_first_id + uint(f_in.instance);
+}
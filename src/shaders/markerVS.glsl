@@ -0,0 +1,26 @@
+#version 430 core
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+// per instance
+layout (location = 2) in mat4 i_model;
+layout (location = 6) in vec4 i_color;
+
+uniform mat4 u_view_projection;
+
+out V_OUT
+{
+   vec3 normal;
+   vec4 color;
+   flat int instance;
+} v_out;
+
+void main()
+{
+    gl_Position = u_view_projection * i_model * vec4(position, 1.0f);
+    v_out.normal = mat3(transpose(inverse(i_model))) * normal;
+    v_out.color = i_color;
+    v_out.instance = gl_InstanceID;
+
+    // markers are never clipped
+    gl_ClipDistance[0] = 1.0;
+}
@@ -12,6 +12,9 @@ uniform float time;
 
 uniform mat4 u_model;
 
+// view-projection the reflection texture was last rendered with
+uniform mat4 reflectionViewProjection;
+
 uniform vec3 cameraPosition;
 uniform vec3 lightPosition;
 
@@ -26,6 +29,7 @@ out V_OUT
    vec3 position;
    vec2 texture_coordinate;
    vec4 clipSpace;
+   vec4 reflectionClipSpace;
 } v_out;
 
 vec3 GerstnerWave(vec4 wave, vec3 p, vec3 tangent)
@@ -51,6 +55,7 @@ void main()
     vec3 sineWaveHeight =vec3(0.0f, GerstnerWave(wave, position, tangent).y,0.0f);
     v_out.position = vec3(position + sineWaveHeight);
     v_out.clipSpace = u_projection * u_view * u_model* vec4( v_out.position, 1.0f);
+    v_out.reflectionClipSpace = reflectionViewProjection * u_model * vec4(v_out.position, 1.0f);
     v_out.texture_coordinate = vec2(v_out.position.x/2.0f+0.5f,v_out.position.z/2.0f+0.5f);
     
     gl_Position = v_out.clipSpace;
@@ -0,0 +1,22 @@
+#version 430 core
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 3) out;
+
+in vec3 v_TexCoords[];
+flat in int v_layer[];
+
+out vec3 TexCoords;
+
+// pass the triangle through to the layer picked by the vertex shader
+void main()
+{
+    for (int i = 0; i < 3; i++)
+    {
+        gl_Layer = v_layer[0];
+        gl_Position = gl_in[i].gl_Position;
+        gl_ClipDistance[0] = gl_in[i].gl_ClipDistance[0];
+        TexCoords = v_TexCoords[i];
+        EmitVertex();
+    }
+    EndPrimitive();
+}
@@ -0,0 +1,32 @@
+#version 430 core
+
+// one view per layer (see tilesLayered.vert)
+layout (std140, binding = 1) uniform layered_matrices
+{
+    mat4 u_projection;
+    mat4 u_layer_view[2];
+    vec4 u_clip_plane[2];
+};
+
+out vec3 v_TexCoords;
+flat out int v_layer;
+
+// a full screen triangle per layer, like skyboxVS
+void main()
+{
+    v_layer = gl_InstanceID;
+
+    vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+
+    // remove translation from the view matrix
+    mat4 view = mat4(mat3(u_layer_view[gl_InstanceID]));
+    mat4 inverse_view_projection = inverse(u_projection * view);
+    vec4 near = inverse_view_projection * vec4(pos, -1.0, 1.0);
+    vec4 far = inverse_view_projection * vec4(pos, 1.0, 1.0);
+    v_TexCoords = far.xyz / far.w - near.xyz / near.w;
+
+    gl_Position = vec4(pos, 1.0, 1.0);
+
+    // the sky is never clipped
+    gl_ClipDistance[0] = 1.0;
+}
@@ -1,19 +1,23 @@
 #version 430 core
 
-// ڪl
-layout(location = 0) in vec3 aPos;
-
 // K
 out vec3 TexCoords;
 
-
 // ƣx
-uniform mat4 projection;
-uniform mat4 view;
+// inverse of projection * view without the translation
+uniform mat4 inverseViewProjection;
 
+// a triangle that covers the screen, at the far plane (depth 1, so it
+// only lands where the depth buffer is still cleared)
 void main()
 {
-    TexCoords = aPos;
-    vec4 pos = projection * view * vec4(aPos, 1.0);
-    gl_Position = pos.xyww;
+    vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+
+    // the direction from the near to the far plane through this pixel
+    vec4 near = inverseViewProjection * vec4(pos, -1.0, 1.0);
+    vec4 far = inverseViewProjection * vec4(pos, 1.0, 1.0);
+    TexCoords = far.xyz / far.w - near.xyz / near.w;
+
+    gl_Position = vec4(pos, 1.0, 1.0);
+    gl_ClipDistance[0] = 1.0;
 }
\ No newline at end of file
@@ -10,13 +10,19 @@ in V_OUT
 
 uniform vec3 u_color;
 
+/* clip_mode
+    0: No clip
+    1: Clip for reflection
+    2: Clip for refraction
+    3: Both at once, layer 0 reflection / layer 1 refraction
+*/
 uniform int clip_mode;
 uniform sampler2D u_texture;
 
 void main()
 {   
     vec3 color = vec3(texture(u_texture, f_in.texture_coordinate));
-    if(clip_mode==1)
+    if(clip_mode==1 || (clip_mode==3 && gl_Layer==0))
         f_color = vec4(color, 0.5f);
     else
          f_color = vec4(color, 1.0f);
@@ -5,7 +5,6 @@ layout (location = 2) in vec2 texture_coordinate;
 
 const float PI = 3.14159;
 uniform mat4 u_model;
-uniform mat4 new_view_matrix;
 uniform float WATER_HEIGHT;
 uniform commom_matrices
 {
@@ -0,0 +1,38 @@
+#version 430 core
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec2 texture_coordinate;
+
+uniform mat4 u_model;
+
+// one view and clip plane per layer
+//  0: reflection
+//  1: refraction
+layout (std140, binding = 1) uniform layered_matrices
+{
+    mat4 u_projection;
+    mat4 u_layer_view[2];
+    vec4 u_clip_plane[2];
+};
+
+out V_OUT
+{
+   vec3 position;
+   vec3 normal;
+   vec2 texture_coordinate;
+} v_out;
+
+// the instance is the layer - the geometry shader routes it there
+flat out int v_layer;
+
+void main()
+{
+    v_layer = gl_InstanceID;
+
+    gl_ClipDistance[0] = dot(u_clip_plane[gl_InstanceID], vec4(position, 1.0f));
+    gl_Position = u_projection * u_layer_view[gl_InstanceID] * u_model * vec4(position, 1.0f);
+
+    v_out.position = vec3(u_model * vec4(position, 1.0f));
+    v_out.normal = mat3(transpose(inverse(u_model))) * normal;
+    v_out.texture_coordinate = vec2(texture_coordinate.x, 1.0f - texture_coordinate.y);
+}
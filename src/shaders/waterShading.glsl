@@ -0,0 +1,191 @@
+// The shading both water surfaces share: the planar or screen space
+// reflection, the refraction and how much water there is. sineFS and
+// heightMapFS include it (see Shader::readCode) after declaring f_color,
+// and call shadeWater with their surface's normal.
+
+uniform mat4 u_model;
+uniform sampler2D refractionTexture;
+uniform sampler2D reflectionTexture;
+uniform vec3 cameraPos;
+
+// screen space reflection (reflectionMode 1): march the reflected ray over
+// the finished scene instead of using the planar reflection texture
+layout (std140, binding = 0) uniform commom_matrices
+{
+    mat4 u_projection;
+    mat4 u_view;
+};
+uniform int reflectionMode;
+uniform samplerCube skybox;
+uniform sampler2D sceneColor;
+uniform sampler2D depthPyramid;	// min depth in r, max in g
+uniform int pyramidLevels;
+
+// depth aware shading: how much water there is between the surface and
+// what is under it, from the depth of the refraction pass
+uniform bool depthShading;
+uniform sampler2D refractionDepth;
+uniform mat4 inverseProjection;
+
+// depth prepass: only the depth (and the thin water discard, so both
+// draws cover the same pixels), the shading draw comes after it
+uniform bool depthOnly;
+
+const float MIN_THICKNESS = 0.05f;     // less than this is no water at all
+const float EDGE_SOFTNESS = 2.0f;      // fade in over this much water
+const float ABSORPTION = 0.02f;        // per world unit
+const vec4 WATER_DEEP_COLOR = vec4(0.05f, 0.2f, 0.3f, 1.0f);
+
+// distance from the eye along the view axis, for a depth buffer value
+float viewDistance(vec2 ndc, float depth)
+{
+    vec4 view = inverseProjection * vec4(ndc, depth * 2.0f - 1.0f, 1.0f);
+    return -view.z / view.w;
+}
+
+const int SSR_MAX_STEPS = 64;
+const float SSR_MAX_DISTANCE = 300.0f;
+const float SSR_THICKNESS = 0.002f;
+const float SSR_NEAR = 0.1f;
+
+vec3 toScreen(vec3 world, vec2 size)
+{
+    vec4 clip = u_projection * u_view * vec4(world, 1.0f);
+    vec3 ndc = clip.xyz / clip.w;
+    return vec3((ndc.xy * 0.5f + 0.5f) * size, ndc.z * 0.5f + 0.5f);
+}
+
+// walk the ray in screen space. the min-depth pyramid lets it step over
+// whole cells that are behind it and only go down to single pixels near a
+// surface. depth is linear in screen space, so z moves linearly with t
+bool traceScreenSpace(vec3 origin, vec3 dir, out vec2 hitUV)
+{
+    hitUV = vec2(0.0f);
+    vec2 size = vec2(textureSize(depthPyramid, 0));
+
+    // keep the end of the ray in front of the camera
+    vec3 viewOrigin = (u_view * vec4(origin, 1.0f)).xyz;
+    vec3 viewDir = mat3(u_view) * dir;
+    float len = SSR_MAX_DISTANCE;
+    if (viewOrigin.z + viewDir.z * len > -SSR_NEAR)
+        len = (-SSR_NEAR - viewOrigin.z) / viewDir.z * 0.99f;
+    if (len <= 0.0f)
+        return false;
+
+    vec3 start = toScreen(origin, size);
+    vec3 d = toScreen(origin + dir * len, size) - start;
+    float pixels = max(abs(d.x), abs(d.y));
+    if (pixels < 1.0f)
+        return false;
+
+    // start a pixel out so the ray doesn't hit what is under the water
+    float t = 1.0f / pixels;
+    float nudge = 0.01f / pixels;
+    int level = 0;
+    for (int i = 0; i < SSR_MAX_STEPS && t <= 1.0f; i++)
+    {
+        vec3 p = start + d * t;
+        if (any(lessThan(p.xy, vec2(0.0f))) || any(greaterThanEqual(p.xy, size)))
+            return false;
+
+        float cellSize = exp2(float(level));
+        vec2 cell = floor(p.xy / cellSize);
+        float minDepth = texelFetch(depthPyramid, ivec2(cell), level).r;
+
+        // where the ray leaves this cell
+        vec2 bound = (cell + step(vec2(0.0f), d.xy)) * cellSize;
+        vec2 tBound = vec2(
+            abs(d.x) > 1e-5f ? (bound.x - start.x) / d.x : 2.0f,
+            abs(d.y) > 1e-5f ? (bound.y - start.y) / d.y : 2.0f);
+        float tExit = min(tBound.x, tBound.y) + nudge;
+        float deepest = max(p.z, start.z + d.z * min(tExit, 1.0f));
+
+        if (deepest < minDepth)
+        {
+            // in front of everything in the cell - skip it, and try bigger
+            t = tExit;
+            level = min(level + 1, pyramidLevels - 1);
+        }
+        else if (level == 0)
+        {
+            if (deepest - minDepth < SSR_THICKNESS)
+            {
+                hitUV = (cell + 0.5f) / size;
+                return true;
+            }
+            // went behind something thick - keep looking past it
+            t = tExit;
+        }
+        else
+        {
+            // might hit in here - move up to the nearest depth, look closer
+            if (d.z > 0.0f && p.z < minDepth)
+                t = max(t, (minDepth - start.z) / d.z);
+            level--;
+        }
+    }
+    return false;
+}
+
+// the colour of the water at this fragment, into f_color. position is in
+// model space, the clip spaces are the ones of the view and of the
+// reflection pass
+void shadeWater(vec3 position, vec3 normal, vec4 clipSpace, vec4 reflectionClipSpace)
+{
+    vec2 ndc = (clipSpace.xy/clipSpace.w)/2.0f +0.5f;
+    // the reflection may be a few frames old - look it up where this
+    // point was when it was rendered
+    vec2 reflectionNdc = (reflectionClipSpace.xy/reflectionClipSpace.w)/2.0f +0.5f;
+    vec2 reflectTexCoords = vec2(-(1-reflectionNdc.x), -(1-reflectionNdc.y));
+    vec2 refractTexCoords = vec2(ndc.x, ndc.y);
+    
+    vec3 toCam = normalize(position-cameraPos);
+    float dis = distance(normal, toCam)*0.02f;
+
+    // thickness of the water here. where there is (almost) none, skip the
+    // reflection and refraction lookups - after the derivatives of the
+    // normal, they need the whole quad
+    float thickness = 0.0f;
+    if (depthShading)
+    {
+        vec2 ndcXY = ndc * 2.0f - 1.0f;
+        float floorDistance = viewDistance(ndcXY, texture(refractionDepth, ndc).r);
+        thickness = floorDistance - viewDistance(ndcXY, gl_FragCoord.z);
+        if (thickness < MIN_THICKNESS)
+            discard;
+    }
+    if (depthOnly)
+        return;
+
+    // Colors
+
+    vec4 reflectionColor;
+    if (reflectionMode == 1)
+    {
+        // the sky where the ray leaves the screen
+        vec3 worldPos = vec3(u_model * vec4(position, 1.0f));
+        vec3 reflected = reflect(normalize(worldPos - cameraPos), normal);
+        vec2 hitUV;
+        if (traceScreenSpace(worldPos, reflected, hitUV))
+            reflectionColor = texture(sceneColor, hitUV);
+        else
+            reflectionColor = texture(skybox, reflected);
+    }
+    else
+        reflectionColor = texture(reflectionTexture, reflectTexCoords+dis);
+    vec4 refractionColor = texture(refractionTexture, refractTexCoords+dis);
+    // deeper water lets less of the bottom through
+    if (depthShading)
+        refractionColor = mix(refractionColor, WATER_DEEP_COLOR, 1.0f - exp(-thickness * ABSORPTION));
+
+    const vec4 WATER_COLOR = vec4(0.83f, 0.94f, 0.97f, 1.0f);
+
+    float lightIndensity = dot(normal,vec3(0.0f, 1.0f, 0.0f));
+
+    f_color = mix(refractionColor,reflectionColor, 0.5f);
+    f_color = mix(f_color, WATER_COLOR,0.2f);
+    f_color = f_color*lightIndensity;
+    // soft edge where the water meets the tiles
+    if (depthShading)
+        f_color.a *= clamp(thickness / EDGE_SOFTNESS, 0.0f, 1.0f);
+}